@@ -0,0 +1,75 @@
+#include <gh4ck3r/base64.hh>
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+
+namespace base64 = gh4ck3r::base64;
+
+namespace {
+
+std::vector<uint8_t> make_data(const size_t len) {
+  std::vector<uint8_t> data(len);
+  for (size_t i = 0; i < len; ++i) data[i] = static_cast<uint8_t>(i * 7 + i / 256);
+  return data;
+}
+
+void encode(benchmark::State &state, const base64::detail::kernel k) {
+  const auto data = make_data(static_cast<size_t>(state.range(0)));
+  std::string out(base64::encoded_size(data.size()), 0x00);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(k.encode(data.data(), data.size(), out.data()));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+void decode(benchmark::State &state, const base64::detail::kernel k) {
+  const auto data = make_data(static_cast<size_t>(state.range(0)));
+  std::string encoded(base64::encoded_size(data.size()), 0x00);
+  base64::encode_to(data.data(), data.size(), encoded.data());
+  std::vector<uint8_t> out(data.size() + 3);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(k.decode(encoded.data(), encoded.size(), out.data()));
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+[[maybe_unused]] const auto registered = [] {
+  namespace detail = base64::detail;
+  std::vector<detail::kernel> kernels {
+    {"scalar", detail::scalar::encode, detail::scalar::decode}};
+#ifdef GH4CK3R_BASE64_SIMD
+  if (__builtin_cpu_supports("ssse3"))
+    kernels.push_back({"ssse3", detail::ssse3::encode, detail::ssse3::decode});
+  if (__builtin_cpu_supports("avx2"))
+    kernels.push_back({"avx2", detail::avx2::encode, detail::avx2::decode});
+  if (__builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("avx512bw"))
+    kernels.push_back({"avx512vbmi", detail::avx512vbmi::encode, detail::avx512vbmi::decode});
+#endif
+  for (const auto &k : kernels) {
+    benchmark::RegisterBenchmark((std::string {"base64_encode/"} + k.name).c_str(), encode, k)
+      ->RangeMultiplier(16)->Range(16, 1 << 20);
+    benchmark::RegisterBenchmark((std::string {"base64_decode/"} + k.name).c_str(), decode, k)
+      ->RangeMultiplier(16)->Range(16, 1 << 20);
+  }
+  return true;
+}();
+
+void base64_Encoder(benchmark::State &state) {
+  const auto data = make_data(1 << 20);
+  const auto chunk = static_cast<size_t>(state.range(0));
+  for (auto _ : state) {
+    size_t total = 0;
+    base64::Encoder enc {[&total] (std::string_view s) { total += s.size(); return true; }};
+    for (size_t off = 0; off < data.size(); off += chunk) {
+      enc.update(data.data() + off, std::min(chunk, data.size() - off));
+    }
+    enc.finalize();
+    benchmark::DoNotOptimize(total);
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(data.size()));
+}
+BENCHMARK(base64_Encoder)->RangeMultiplier(16)->Range(16, 1 << 16);
+
+} // namespace
@@ -0,0 +1,113 @@
+#include <gh4ck3r/crypto.hh>
+#include <benchmark/benchmark.h>
+#include <array>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace crypto = gh4ck3r::crypto;
+using Alg = crypto::Alg;
+using Mode = crypto::Mode;
+
+namespace {
+
+template <template <Alg, Mode> class CIPHER, Alg alg, Mode mode>
+void cipher(benchmark::State &state) {
+  const std::vector<uint8_t> data(static_cast<size_t>(state.range(0)), 0x5a);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(CIPHER<alg, mode> {}.update(data.data(), data.size()).finalize());
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(cipher<crypto::v3::Encryptor, Alg::SEED, Mode::CBC>)
+  ->RangeMultiplier(16)->Range(16, 1 << 20);
+BENCHMARK(cipher<crypto::v1::Encryptor, Alg::SEED, Mode::CBC>)
+  ->RangeMultiplier(16)->Range(16, 1 << 20);
+
+// small messages into a buffer reused across them
+void encrypt_span(benchmark::State &state) {
+  using Enc = crypto::Encryptor<Alg::AES_128, Mode::CBC>;
+  const std::vector<uint8_t> data(static_cast<size_t>(state.range(0)), 0x5a);
+  std::vector<uint8_t> out(Enc::max_output(data.size()) + Enc::max_output(0));
+  for (auto _ : state) {
+    Enc enc;
+    const auto n = enc.update(data, out);
+    benchmark::DoNotOptimize(n + enc.finalize(std::span {out}.subspan(n)));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(encrypt_span)->RangeMultiplier(4)->Range(64, 4096);
+
+// messages of their own key and IV
+template <template <Alg, Mode> class CIPHER, Alg alg>
+void message_new(benchmark::State &state) {
+  const std::vector<uint8_t> data(static_cast<size_t>(state.range(0)), 0x5a);
+  typename CIPHER<alg, Mode::CBC>::KEY key {};
+  for (auto _ : state) {
+    ++key[0];
+    benchmark::DoNotOptimize(CIPHER<alg, Mode::CBC> {key}.update(data.data(), data.size()).finalize());
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(message_new<crypto::v1::Encryptor, Alg::SEED>)->RangeMultiplier(4)->Range(64, 4096);
+BENCHMARK(message_new<crypto::v3::Encryptor, Alg::SEED>)->RangeMultiplier(4)->Range(64, 4096);
+BENCHMARK(message_new<crypto::v1::Encryptor, Alg::AES_128>)->RangeMultiplier(4)->Range(64, 4096);
+BENCHMARK(message_new<crypto::v3::Encryptor, Alg::AES_128>)->RangeMultiplier(4)->Range(64, 4096);
+
+template <Alg alg>
+void message_reset(benchmark::State &state) {
+  using Enc = crypto::Encryptor<alg, Mode::CBC>;
+  const std::vector<uint8_t> data(static_cast<size_t>(state.range(0)), 0x5a);
+  std::vector<uint8_t> out(Enc::max_output(data.size()) + Enc::max_output(0));
+  typename Enc::KEY key {};
+  Enc enc;
+  for (auto _ : state) {
+    ++key[0];
+    const auto n = enc.reset(key).update(data, out);
+    benchmark::DoNotOptimize(n + enc.finalize(std::span {out}.subspan(n)));
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(message_reset<Alg::SEED>)->RangeMultiplier(4)->Range(64, 4096);
+BENCHMARK(message_reset<Alg::AES_128>)->RangeMultiplier(4)->Range(64, 4096);
+
+template <Mode mode>
+void decrypt_parallel(benchmark::State &state) {
+  const std::array<uint8_t, 16> key {1}, iv {2};
+  const std::vector<uint8_t> plaintext(static_cast<size_t>(state.range(0)), 0x5a);
+  const auto ciphertext = crypto::Encryptor<Alg::AES_128, mode> {key, iv}
+    .update(plaintext.data(), plaintext.size())
+    .finalize();
+  std::vector<uint8_t> out(ciphertext.size());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(crypto::decrypt_parallel<Alg::AES_128, mode>(
+          key, iv, ciphertext, out, static_cast<unsigned>(state.range(1))));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(decrypt_parallel<Mode::CBC>)
+  ->ArgsProduct({{1 << 16, 1 << 20, 1 << 24}, {1, 2, 4, 8}})->UseRealTime();
+BENCHMARK(decrypt_parallel<Mode::CTR>)
+  ->ArgsProduct({{1 << 16, 1 << 20, 1 << 24}, {1, 2, 4, 8}})->UseRealTime();
+
+void crypt_stream(benchmark::State &state) {
+  namespace fs = gh4ck3r::filesystem;
+  const auto chunk_siz = static_cast<size_t>(state.range(0));
+  fs::FileWriter<fs::TempFile> src;
+  src.write(std::vector<uint8_t>(64 << 20, 0x5a));
+  const auto devnull = ::open("/dev/null", O_WRONLY);
+  for (auto _ : state) {
+    ::lseek(src.fd(), 0, SEEK_SET);
+    crypto::Encryptor<Alg::AES_128, Mode::CTR> enc;
+    benchmark::DoNotOptimize(crypto::crypt_stream(enc, src.fd(), devnull, chunk_siz));
+  }
+  ::close(devnull);
+  state.SetBytesProcessed(state.iterations() * (64 << 20));
+}
+BENCHMARK(crypt_stream)->RangeMultiplier(4)->Range(64 << 10, 4 << 20)->UseRealTime();
+
+} // namespace
@@ -0,0 +1,58 @@
+#include <gh4ck3r/defer.hh>
+#include <benchmark/benchmark.h>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using gh4ck3r::Defer;
+using gh4ck3r::InplaceDefer;
+
+namespace {
+std::atomic<size_t> nalloc {0};
+} // namespace
+
+// Counts allocations; GCC can't tell the replaced pair match each other.
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void *operator new(const size_t siz) {
+  nalloc.fetch_add(1, std::memory_order_relaxed);
+  if (auto p = std::malloc(siz ? siz : 1); p) return p;
+  throw std::bad_alloc {};
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+// Captures as large as a handful of fds and a reference, which is beyond
+// the small buffer of std::function.
+template <typename MAKE>
+void scope(benchmark::State &state, MAKE make) {
+  std::array<int, 8> fds {};
+  int sum = 0;
+  const auto before = nalloc.load();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(fds);
+    const auto defer = make([&sum, fds] { sum += fds[0] + fds[7]; });
+  }
+  benchmark::DoNotOptimize(sum);
+  state.counters["allocs_per_scope"] = benchmark::Counter(
+      static_cast<double>(nalloc.load() - before) / static_cast<double>(state.iterations()));
+}
+
+void defer_function(benchmark::State &state) {
+  scope(state, [] (auto fn) { return Defer<> {fn}; });
+}
+BENCHMARK(defer_function);
+
+void defer_inline(benchmark::State &state) {
+  scope(state, [] (auto fn) { return Defer {fn}; });
+}
+BENCHMARK(defer_inline);
+
+void defer_inplace(benchmark::State &state) {
+  scope(state, [] (auto fn) { return InplaceDefer<48> {fn}; });
+}
+BENCHMARK(defer_inplace);
+
+} // namespace
@@ -0,0 +1,226 @@
+#include <gh4ck3r/file.hh>
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <map>
+#include <numeric>
+#include <string>
+#include <vector>
+
+namespace fs = gh4ck3r::filesystem;
+
+namespace {
+
+fs::path_t make_file(const fs::TempDir &dir, const size_t len) {
+  const auto p = dir / std::to_string(len);
+  if (!fs::exists(p)) {
+    std::vector<uint8_t> data(len);
+    std::iota(data.begin(), data.end(), 0);
+    std::ofstream {p, std::ios::binary}
+      .write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(len));
+  }
+  return p;
+}
+
+const fs::TempDir tmpdir {"file.bench"};
+
+void load_file(benchmark::State &state) {
+  const auto p = make_file(tmpdir, static_cast<size_t>(state.range(0)));
+  for (auto _ : state) benchmark::DoNotOptimize(fs::load_file<std::vector<uint8_t>>(p));
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(load_file)->RangeMultiplier(16)->Range(1 << 10, 1 << 26);
+
+void mapped_file(benchmark::State &state) {
+  const auto p = make_file(tmpdir, static_cast<size_t>(state.range(0)));
+  for (auto _ : state) {
+    const fs::mapped_file f {p, {.populate = true}};
+    benchmark::DoNotOptimize(std::accumulate(f.begin(), f.end(), uint8_t {}));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(mapped_file)->RangeMultiplier(16)->Range(1 << 10, 1 << 26);
+
+// 64M with a 4K block of data at every 4M
+fs::path_t make_sparse(const fs::TempDir &dir) {
+  const auto p = dir / "sparse";
+  if (!fs::exists(p)) {
+    const fs::unique_fd fd {::open(p.c_str(), O_WRONLY | O_CREAT, 0644)};
+    const std::vector<char> data(4096, 'x');
+    for (off_t off = 0; off < (64 << 20); off += 4 << 20)
+      ::pwrite(fd, data.data(), data.size(), off);
+    ::ftruncate(fd, 64 << 20);
+  }
+  return p;
+}
+
+void load_file_sparse(benchmark::State &state) {
+  const auto p = make_sparse(tmpdir);
+  for (auto _ : state) benchmark::DoNotOptimize(fs::load_file<std::vector<uint8_t>>(p));
+  state.SetBytesProcessed(state.iterations() * (64 << 20));
+}
+BENCHMARK(load_file_sparse);
+
+void copy_sparse(benchmark::State &state) {
+  const auto src = make_sparse(tmpdir);
+  const auto dst = tmpdir / "sparse.copy";
+  for (auto _ : state) {
+    fs::copy_tree(src, dst);
+    state.PauseTiming();
+    fs::remove(dst);
+    state.ResumeTiming();
+  }
+  state.SetBytesProcessed(state.iterations() * (64 << 20));
+}
+BENCHMARK(copy_sparse);
+
+template <typename WRITER>
+void write_small(benchmark::State &state, WRITER &writer) {
+  const std::string record(static_cast<size_t>(state.range(0)), 'x');
+  for (auto _ : state) benchmark::DoNotOptimize(writer.write(record));
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+void FileWriter(benchmark::State &state) {
+  fs::FileWriter<fs::TempFile> writer;
+  write_small(state, writer);
+}
+BENCHMARK(FileWriter)->RangeMultiplier(8)->Range(8, 1 << 15);
+
+void BufferedFileWriter(benchmark::State &state) {
+  fs::BufferedFileWriter<fs::TempFile> writer {{.use_io_uring = state.range(1) != 0}};
+  write_small(state, writer);
+}
+BENCHMARK(BufferedFileWriter)->ArgsProduct({benchmark::CreateRange(8, 1 << 15, 8), {0, 1}});
+
+// 16 directories of 64 files of 4K each
+const fs::path_t &make_tree() {
+  static const auto root = [] {
+    const auto root = tmpdir / "tree";
+    const std::vector<char> data(4096, 'x');
+    for (int d = 0; d < 16; ++d) {
+      const auto dir = root / std::to_string(d);
+      fs::create_directories(dir);
+      for (int f = 0; f < 64; ++f)
+        std::ofstream {dir / std::to_string(f)}.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+    return root;
+  }();
+  return root;
+}
+
+void copy_tree(benchmark::State &state) {
+  const auto &src = make_tree();
+  const auto dst = tmpdir / "tree.copy";
+  fs::copy_progress progress;
+  for (auto _ : state) {
+    fs::copy_tree(src, dst, &progress, static_cast<unsigned>(state.range(0)));
+    state.PauseTiming();
+    fs::remove_all(dst);
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(progress.files.load()));
+  state.SetBytesProcessed(static_cast<int64_t>(progress.bytes.load()));
+}
+BENCHMARK(copy_tree)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+void copy_recursive(benchmark::State &state) {
+  const auto &src = make_tree();
+  const auto dst = tmpdir / "tree.copy";
+  for (auto _ : state) {
+    fs::copy(src, dst, fs::copy_options::recursive);
+    state.PauseTiming();
+    fs::remove_all(dst);
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * 16 * 64);
+}
+BENCHMARK(copy_recursive)->UseRealTime();
+
+// a spool directory of `n` empty files
+const fs::path_t &make_spool(const size_t n) {
+  static std::map<size_t, fs::path_t> spools;
+  auto &p = spools[n];
+  if (p.empty()) {
+    p = tmpdir / ("spool." + std::to_string(n));
+    fs::create_directories(p);
+    for (size_t i = 0; i < n; ++i) std::ofstream {p / std::to_string(i)};
+  }
+  return p;
+}
+
+void dir_siz(benchmark::State &state) {
+  const auto &dir = make_spool(static_cast<size_t>(state.range(0)));
+  for (auto _ : state) benchmark::DoNotOptimize(fs::dir_siz(dir));
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(dir_siz)->RangeMultiplier(10)->Range(100, 100000);
+
+// a poll and size query against a watched spool, in place of dir_siz
+void DirectoryIndex(benchmark::State &state) {
+  const auto &dir = make_spool(static_cast<size_t>(state.range(0)));
+  fs::DirectoryIndex index {dir};
+  for (auto _ : state) {
+    index.poll();
+    benchmark::DoNotOptimize(index.size());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(DirectoryIndex)->RangeMultiplier(10)->Range(100, 100000);
+
+void directory_iterator(benchmark::State &state) {
+  const auto &dir = make_spool(static_cast<size_t>(state.range(0)));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(std::distance(fs::directory_iterator {dir}, fs::directory_iterator {}));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(directory_iterator)->RangeMultiplier(10)->Range(100, 100000);
+
+void walk(benchmark::State &state) {
+  const auto &root = make_tree();
+  std::atomic<size_t> n {0};
+  for (auto _ : state) {
+    fs::walk(root, [&n] (const fs::walk_entry &) { n.fetch_add(1, std::memory_order_relaxed); },
+        static_cast<unsigned>(state.range(0)));
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(n.load()));
+}
+BENCHMARK(walk)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+void recursive_directory_iterator(benchmark::State &state) {
+  const auto &root = make_tree();
+  size_t n = 0;
+  for (auto _ : state) {
+    for (const auto &e : fs::recursive_directory_iterator {root}) {
+      benchmark::DoNotOptimize(e.is_directory());
+      ++n;
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(n));
+}
+BENCHMARK(recursive_directory_iterator)->UseRealTime();
+
+// Writing a small upload and putting it in place
+void publish_tempfile(benchmark::State &state) {
+  const auto dst = tmpdir / "upload";
+  for (auto _ : state) {
+    const auto [fd, p] = fs::create_tempfile(tmpdir / "");
+    ::write(fd, "upload", 6);
+    fs::rename(p, dst);
+    ::close(fd);
+  }
+}
+BENCHMARK(publish_tempfile);
+
+void publish_pooled(benchmark::State &state) {
+  const auto dst = tmpdir / "upload";
+  fs::TempFilePool pool {{.dir = tmpdir.path(), .capacity = 64}};
+  for (auto _ : state) {
+    fs::FileWriter<fs::PooledFile> writer {pool};
+    writer.write(std::string_view {"upload"});
+    writer.file().publish(dst);
+  }
+}
+BENCHMARK(publish_pooled);
+
+} // namespace
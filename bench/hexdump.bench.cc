@@ -0,0 +1,41 @@
+#include <gh4ck3r/hexdump.hh>
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+using gh4ck3r::hexdump;
+using gh4ck3r::hexdump_to;
+
+namespace {
+
+void hexdump_string(benchmark::State &state) {
+  const std::vector<uint8_t> data(static_cast<size_t>(state.range(0)), 0x5a);
+  for (auto _ : state) benchmark::DoNotOptimize(hexdump(data));
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(hexdump_string)->RangeMultiplier(16)->Range(16, 1 << 20);
+
+void hexdump_to_callback(benchmark::State &state) {
+  const std::vector<uint8_t> data(static_cast<size_t>(state.range(0)), 0x5a);
+  for (auto _ : state) {
+    size_t n = 0;
+    hexdump_to([&n] (const std::string_view rows) { n += rows.size(); }, data);
+    benchmark::DoNotOptimize(n);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(hexdump_to_callback)->RangeMultiplier(16)->Range(16, 1 << 20);
+
+void hexdump_to_callback16(benchmark::State &state) {
+  const std::vector<uint16_t> data(static_cast<size_t>(state.range(0)) / 2, 0x5a5a);
+  for (auto _ : state) {
+    size_t n = 0;
+    hexdump_to([&n] (const std::string_view rows) { n += rows.size(); }, data);
+    benchmark::DoNotOptimize(n);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(hexdump_to_callback16)->RangeMultiplier(16)->Range(16, 1 << 20);
+
+} // namespace
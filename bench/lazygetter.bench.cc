@@ -0,0 +1,33 @@
+#include <gh4ck3r/lazygetter.hh>
+#include <benchmark/benchmark.h>
+#include <string>
+
+using gh4ck3r::LazyGetter;
+using gh4ck3r::UnsyncLazyGetter;
+
+namespace {
+
+const auto load_config = [] { return std::string {"value of some config"}; };
+
+// Reads after the value is fetched, as request handlers do.
+void read(benchmark::State &state) {
+  static LazyGetter config {load_config};
+  for (auto _ : state) {
+    const std::string &v = config;
+    benchmark::DoNotOptimize(v.size());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(read)->ThreadRange(1, 8)->UseRealTime();
+
+void read_unsync(benchmark::State &state) {
+  UnsyncLazyGetter config {load_config};
+  for (auto _ : state) {
+    const std::string &v = config;
+    benchmark::DoNotOptimize(v.size());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(read_unsync);
+
+} // namespace
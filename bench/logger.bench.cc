@@ -0,0 +1,74 @@
+#include <gh4ck3r/logger.hh>
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <streambuf>
+#include <string>
+
+using gh4ck3r::AsyncLogger;
+using gh4ck3r::Logger;
+using gh4ck3r::indent;
+using gh4ck3r::unindent;
+
+namespace {
+
+// Sink discarding everything but counting it.
+class null_buf : public std::streambuf {
+ public:
+  size_t n {0};
+
+ private:
+  int overflow(int c) override { ++n; return traits_type::not_eof(c); }
+  std::streamsize xsputn(const char *, std::streamsize len) override {
+    n += static_cast<size_t>(len);
+    return len;
+  }
+};
+
+const std::string line(static_cast<size_t>(80), 'x');
+
+void logger_sync(benchmark::State &state) {
+  null_buf sink;
+  std::ostream os {&sink};
+  Logger logger {os, static_cast<size_t>(state.range(0))};
+  for (auto _ : state) {
+    logger << indent() << line << '\n' << 42 << ' ' << line << '\n' << unindent();
+  }
+  logger.flush();
+  state.SetBytesProcessed(static_cast<int64_t>(sink.n));
+}
+BENCHMARK(logger_sync)->Arg(0)->Arg(4096);
+
+void logger_large(benchmark::State &state) {
+  null_buf sink;
+  std::ostream os {&sink};
+  Logger logger {os};
+  std::string text;
+  while (text.size() < static_cast<size_t>(state.range(0))) text += line + '\n';
+  for (auto _ : state) logger << indent() << text << unindent();
+  state.SetBytesProcessed(static_cast<int64_t>(sink.n));
+}
+BENCHMARK(logger_large)->RangeMultiplier(16)->Range(1 << 10, 1 << 20);
+
+void async_logger(benchmark::State &state) {
+  static null_buf sink;
+  static std::ostream os {&sink};
+  static AsyncLogger *logger;
+  if (state.thread_index() == 0) {
+    logger = new AsyncLogger {os, {.ring_siz = 1 << 20,
+      .policy = static_cast<AsyncLogger::overflow_policy>(state.range(0))}};
+  }
+  // per record latency on the calling thread
+  for (auto _ : state) *logger << indent() << line << ' ' << 42 << '\n' << unindent();
+  if (state.thread_index() == 0) {
+    state.counters["dropped"] = static_cast<double>(logger->dropped());
+    delete logger;
+  }
+}
+BENCHMARK(async_logger)
+  ->Arg(static_cast<int>(AsyncLogger::overflow_policy::block))
+  ->Arg(static_cast<int>(AsyncLogger::overflow_policy::drop))
+  ->Arg(static_cast<int>(AsyncLogger::overflow_policy::overwrite))
+  ->ThreadRange(1, 4)
+  ->UseRealTime();
+
+} // namespace
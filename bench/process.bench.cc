@@ -0,0 +1,89 @@
+#include <gh4ck3r/process.hh>
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+
+namespace process = gh4ck3r::process;
+
+namespace {
+
+void execute(benchmark::State &state) {
+  for (auto _ : state) process::wait(process::execute("/bin/true"));
+}
+BENCHMARK(execute)->UseRealTime();
+
+void spawn(benchmark::State &state) {
+  for (auto _ : state) process::wait(process::spawn("/bin/true"));
+}
+BENCHMARK(spawn)->UseRealTime();
+
+void ChildSet(benchmark::State &state) {
+  const auto n = state.range(0);
+  for (auto _ : state) {
+    process::ChildSet children;
+    for (int64_t i = 0; i < n; ++i) children.add(process::spawn("/bin/true"));
+    while (!children.empty()) benchmark::DoNotOptimize(children.reap());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(ChildSet)->RangeMultiplier(4)->Range(1, 64)->UseRealTime();
+
+// An environment of `n` variables as a spawn heavy service would have.
+std::vector<std::string> make_environ(const int64_t n) {
+  std::vector<std::string> env;
+  for (int64_t i = 0; i < n; ++i)
+    env.push_back("VARIABLE_" + std::to_string(i) + "=" + std::string(32, 'v'));
+  return env;
+}
+
+void Env_parse(benchmark::State &state) {
+  const auto strs = make_environ(state.range(0));
+  std::vector<char *> envp;
+  for (auto &s : strs) envp.push_back(const_cast<char *>(s.c_str()));
+  envp.push_back(nullptr);
+  for (auto _ : state) {
+    const process::Env env {envp.data()};
+    benchmark::DoNotOptimize(static_cast<char *const *>(env));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(Env_parse)->Arg(16)->Arg(256);
+
+// Per exec cost of a base environment with one variable changed.
+void Env_derive(benchmark::State &state) {
+  const auto strs = make_environ(state.range(0));
+  std::vector<char *> envp;
+  for (auto &s : strs) envp.push_back(const_cast<char *>(s.c_str()));
+  envp.push_back(nullptr);
+  const process::Env base {envp.data()};
+  for (auto _ : state) {
+    const process::Env env {base, {{"REQUEST_ID", "42"}}};
+    benchmark::DoNotOptimize(static_cast<char *const *>(env));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(Env_derive)->Arg(16)->Arg(256);
+
+void ProcSnapshot_refresh(benchmark::State &state) {
+  process::ProcSnapshot snapshot;
+  for (auto _ : state) snapshot.refresh();
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(snapshot.size()));
+}
+BENCHMARK(ProcSnapshot_refresh);
+
+// The same columns through the per process functions
+void ProcSnapshot_baseline(benchmark::State &state) {
+  const process::ProcSnapshot snapshot;
+  const auto pids = snapshot.pids();
+  for (auto _ : state) {
+    for (const auto pid : pids) {
+      benchmark::DoNotOptimize(process::nameof(pid));
+      benchmark::DoNotOptimize(process::ppidof(pid));
+      benchmark::DoNotOptimize(process::cmdof(pid));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(pids.size()));
+}
+BENCHMARK(ProcSnapshot_baseline);
+
+} // namespace
@@ -0,0 +1,24 @@
+#include <gh4ck3r/singleton.hh>
+#include <benchmark/benchmark.h>
+#include <memory>
+
+using gh4ck3r::SharedSingleton;
+
+namespace {
+
+struct Instance { int v {0}; };
+using S = SharedSingleton<Instance>;
+
+// Instance kept alive by the main thread, so every construction is a lookup.
+void get_instance(benchmark::State &state) {
+  static std::unique_ptr<S> keep;
+  if (state.thread_index() == 0) keep = std::make_unique<S>();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(S {}.get());
+  }
+  if (state.thread_index() == 0) keep.reset();
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(get_instance)->ThreadRange(1, 64)->UseRealTime();
+
+} // namespace
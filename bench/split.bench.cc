@@ -0,0 +1,84 @@
+#include <gh4ck3r/split.hh>
+#include <benchmark/benchmark.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using gh4ck3r::split;
+using gh4ck3r::split_view;
+
+namespace {
+
+// fields of 1 to 16 characters separated by ','
+std::string make_csv(const size_t len) {
+  std::string s;
+  s.reserve(len);
+  for (size_t i = 0; s.size() < len; ++i) {
+    s.append(1 + i * 7 % 16, static_cast<char>('a' + i % 26));
+    s += ',';
+  }
+  s.resize(len);
+  return s;
+}
+
+// split() as it was before split_view, kept as the baseline
+std::vector<std::string_view> find_tokens(const std::string_view str) {
+  std::vector<std::string_view> ret {};
+  constexpr auto npos = std::string_view::npos;
+  size_t beg = 0, end = 0;
+  do {
+    end = str.find_first_of(',', beg);
+    ret.emplace_back(str.substr(beg, end == npos ? npos : end - beg));
+    beg = end + 1;
+  } while (end != npos);
+  return ret;
+}
+
+void split_find(benchmark::State &state) {
+  const auto str = make_csv(static_cast<size_t>(state.range(0)));
+  for (auto _ : state) benchmark::DoNotOptimize(find_tokens(str));
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(split_find)->RangeMultiplier(16)->Range(64, 1 << 20);
+
+void split_vector(benchmark::State &state) {
+  const auto str = make_csv(static_cast<size_t>(state.range(0)));
+  for (auto _ : state) benchmark::DoNotOptimize(split<','>(str));
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(split_vector)->RangeMultiplier(16)->Range(64, 1 << 20);
+
+void split_view_lazy(benchmark::State &state) {
+  const auto str = make_csv(static_cast<size_t>(state.range(0)));
+  for (auto _ : state) {
+    size_t n = 0;
+    for (const auto token : split_view<','> {str}) n += token.size();
+    benchmark::DoNotOptimize(n);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(split_view_lazy)->RangeMultiplier(16)->Range(64, 1 << 20);
+
+void split_view_escape(benchmark::State &state) {
+  const auto str = make_csv(static_cast<size_t>(state.range(0)));
+  for (auto _ : state) {
+    size_t n = 0;
+    for (const auto token : split_view<',', '\\'> {str}) n += token.size();
+    benchmark::DoNotOptimize(n);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(split_view_escape)->RangeMultiplier(16)->Range(64, 1 << 20);
+
+void split_view_any_of(benchmark::State &state) {
+  const auto str = make_csv(static_cast<size_t>(state.range(0)));
+  for (auto _ : state) {
+    size_t n = 0;
+    for (const auto token : split_view<gh4ck3r::any_of<',', ';', '\t'>> {str}) n += token.size();
+    benchmark::DoNotOptimize(n);
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(split_view_any_of)->RangeMultiplier(16)->Range(64, 1 << 20);
+
+} // namespace
@@ -1,112 +1,449 @@
 #pragma once
+#include <algorithm>
+#include <functional>
 #include <iterator>
-#include <sstream>
+#include <span>
+#include <stdexcept>
+#include <string>
 #include <string_view>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <cstdint>
 
+#if !defined(GH4CK3R_BASE64_NO_SIMD) && defined(__x86_64__) && defined(__GNUC__)
+#define GH4CK3R_BASE64_SIMD 1
+#include <immintrin.h>
+#endif
+
 namespace gh4ck3r::base64 {
 
-#pragma pack(1)
-union unit {
-    uint8_t t[3];
-    struct {
-        std::remove_extent_t<decltype(t)>
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-            c4:6, c3:6, c2:6, c1:6;
-#elif __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
-            c1:6, c2:6, c3:6, c4:6;
-#else
-#error Check endianess
-#endif
-    } q;
+inline constexpr size_t npos = static_cast<size_t>(-1);
+
+/// Number of characters `encode_to` writes for `len` bytes.
+constexpr size_t encoded_size(const size_t len) { return (len + 2) / 3 * 4; }
+
+/// Number of bytes `decode_to` writes for a well formed `b64str`.
+constexpr size_t decoded_size(std::string_view b64str) {
+    for (int i = 0; i < 2 && b64str.ends_with('='); ++i)
+        b64str.remove_suffix(1);
+    constexpr size_t tail[] {0, 0, 1, 2};
+    return b64str.size() / 4 * 3 + tail[b64str.size() % 4];
+}
+
+namespace detail {
+
+inline constexpr char enc_tbl[] {
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+    "abcdefghijklmnopqrstuvwxyz"
+    "0123456789+/"
 };
-#pragma pack()
-static_assert(sizeof(unit) == 3, "gh4ck3r::base64::unit MUST be packaged");
 
-template<class It>
-std::string encode(It beg, const It end)
-{
-    static_assert(1 == sizeof(*beg));
-    constexpr std::string_view enc_tbl {
-        "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-        "abcdefghijklmnopqrstuvwxyz"
-        "0123456789+/"
-    };
+inline constexpr int8_t dec_tbl[] {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* 00-0F */
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* 10-1F */
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63, /* 20-2F */
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1, /* 30-3F */
+    -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, /* 40-4F */
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, 63, /* 50-5F */
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, /* 60-6F */
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1, /* 70-7F */
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* 80-8F */
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* 90-9F */
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* A0-AF */
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* B0-BF */
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* C0-CF */
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* D0-DF */
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* E0-EF */
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1  /* F0-FF */
+};
+
+// Every kernel encodes/decodes as many blocks as it can and hands the rest
+// over to the scalar one. Decoders return `npos` on invalid input; a SIMD
+// decoder also gives up on a block it can't validate (e.g. '=' or '_') and
+// lets the scalar decoder deal with it.
+using encode_fn = size_t (*)(const uint8_t *src, size_t len, char *dst);
+using decode_fn = size_t (*)(const char *src, size_t len, uint8_t *dst);
+
+namespace scalar {
+
+inline void encode_group(const uint8_t *src, char *dst) {
+    const uint32_t v = uint32_t{src[0]} << 16 | uint32_t{src[1]} << 8 | src[2];
+    dst[0] = enc_tbl[v >> 18 & 0x3f];
+    dst[1] = enc_tbl[v >> 12 & 0x3f];
+    dst[2] = enc_tbl[v >>  6 & 0x3f];
+    dst[3] = enc_tbl[v       & 0x3f];
+}
+
+inline size_t encode(const uint8_t *src, size_t len, char *dst) {
+    const auto out = dst;
+    for (; len >= 12; len -= 12, src += 12, dst += 16) {
+        encode_group(src + 0, dst +  0);
+        encode_group(src + 3, dst +  4);
+        encode_group(src + 6, dst +  8);
+        encode_group(src + 9, dst + 12);
+    }
+    for (; len >= 3; len -= 3, src += 3, dst += 4) encode_group(src, dst);
 
-    unit unit;
-    std::ostringstream os;
-    const auto last {std::prev(end)};
-    for (size_t i = 2; beg != end; i ? --i : i = 2, std::advance(beg, 1)) {
-        unit.t[i] = *beg;
-
-        if (!i || beg == last) {
-            const auto &q = unit.q;
-            os  << enc_tbl[q.c1]
-                << enc_tbl[q.c2]
-                << (i == 2 ? '=' : enc_tbl[q.c3])
-                << (i  > 0 ? '=' : enc_tbl[q.c4]);
-            unit = {{}};
+    if (len) {
+        const uint8_t last[3] {src[0], len > 1 ? src[1] : uint8_t{}, 0};
+        encode_group(last, dst);
+        dst[3] = '=';
+        if (len == 1) dst[2] = '=';
+        dst += 4;
+    }
+    return static_cast<size_t>(dst - out);
+}
+
+inline size_t decode(const char *src, size_t len, uint8_t *dst) {
+    const auto out = dst;
+    // Decoding stops at the first padding character.
+    if (const auto pad = std::string_view{src, len}.find('=');
+        pad != std::string_view::npos)
+    {
+        len = pad;
+    }
+
+    uint32_t v = 0;
+    for (size_t i = 0; i < len; ++i) {
+        const auto d = dec_tbl[static_cast<uint8_t>(src[i])];
+        if (d < 0) [[unlikely]] return npos;
+
+        v = v << 6 | static_cast<uint32_t>(d);
+        if (i % 4 == 3) {
+            dst[0] = static_cast<uint8_t>(v >> 16);
+            dst[1] = static_cast<uint8_t>(v >>  8);
+            dst[2] = static_cast<uint8_t>(v);
+            dst += 3;
+            v = 0;
         }
     }
 
-    return os.str();
+    switch (len % 4) {
+        case 2:
+            *dst++ = static_cast<uint8_t>(v >> 4);
+            break;
+        case 3:
+            *dst++ = static_cast<uint8_t>(v >> 10);
+            *dst++ = static_cast<uint8_t>(v >>  2);
+            break;
+    }
+    return static_cast<size_t>(dst - out);
 }
 
-template<class T>
-T decode_as(const std::string_view b64str)
-{
-    constexpr char dec_tbl[] {
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* 00-0F */
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* 10-1F */
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63, /* 20-2F */
-        52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1, /* 30-3F */
-        -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, /* 40-4F */
-        15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, 63, /* 50-5F */
-        -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, /* 60-6F */
-        41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1, /* 70-7F */
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* 80-8F */
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* 90-9F */
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* A0-AF */
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* B0-BF */
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* C0-CF */
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* D0-DF */
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, /* E0-EF */
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1  /* F0-FF */
-    };
+} // namespace scalar
 
-    T ret;
-    if constexpr (std::conjunction_v<
-            std::is_same<T, std::vector<typename T::value_type>>,
-            std::is_same<T, std::string>>)
-    {
-        ret.reserve(b64str.size() * 3 / 4);
+#ifdef GH4CK3R_BASE64_SIMD
+namespace ssse3 {
+
+#define GH4CK3R_TARGET __attribute__((target("ssse3")))
+
+// Wojciech Muła's reshuffle: 12 bytes -> 16 six bit indices.
+GH4CK3R_TARGET inline __m128i enc_reshuffle(__m128i in) {
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(
+            10, 11,  9, 10,  7,  8,  6,  7,  4,  5,  3,  4,  1,  2,  0,  1));
+    const auto t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    const auto t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const auto t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    const auto t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+GH4CK3R_TARGET inline __m128i enc_translate(const __m128i indices) {
+    const auto shift_lut = _mm_setr_epi8(
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+            '/' - 63, 'A', 0, 0);
+    auto r = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    const auto less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    r = _mm_or_si128(r, _mm_and_si128(less, _mm_set1_epi8(13)));
+    return _mm_add_epi8(_mm_shuffle_epi8(shift_lut, r), indices);
+}
+
+// Returns false if any of 16 characters is out of the standard alphabet.
+GH4CK3R_TARGET inline bool dec_translate(__m128i &str) {
+    const auto lut_lo = _mm_setr_epi8(
+            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+            0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const auto lut_hi = _mm_setr_epi8(
+            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const auto lut_roll = _mm_setr_epi8(
+            0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const auto nibble = _mm_set1_epi8(0x0f);
+
+    const auto hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), nibble);
+    const auto lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(str, nibble));
+    const auto hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())))
+        return false;
+
+    const auto eq_2f = _mm_cmpeq_epi8(str, _mm_set1_epi8('/'));
+    const auto roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+    str = _mm_add_epi8(str, roll);
+    return true;
+}
+
+// 16 six bit values -> 12 bytes in the lower part
+GH4CK3R_TARGET inline __m128i dec_reshuffle(const __m128i values) {
+    const auto ab_bc = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    const auto out = _mm_madd_epi16(ab_bc, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(out, _mm_setr_epi8(
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+GH4CK3R_TARGET inline size_t encode(const uint8_t *src, size_t len, char *dst) {
+    const auto out = dst;
+    for (; len >= 16; len -= 12, src += 12, dst += 16) {
+        const auto in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst),
+                enc_translate(enc_reshuffle(in)));
     }
+    return static_cast<size_t>(dst - out) + scalar::encode(src, len, dst);
+}
 
-    unit u;
-    size_t n {0};
-    for (const auto &c : b64str) {
-        if (c == '=') break;
+GH4CK3R_TARGET inline size_t decode(const char *src, size_t len, uint8_t *dst) {
+    const auto out = dst;
+    // 16 bytes are stored for 12 decoded ones; keep 2 quads ahead.
+    for (; len >= 16 + 8; len -= 16, src += 16, dst += 12) {
+        auto str = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+        if (!dec_translate(str)) break;
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), dec_reshuffle(str));
+    }
+    const auto n = scalar::decode(src, len, dst);
+    return n == npos ? npos : static_cast<size_t>(dst - out) + n;
+}
 
-        const auto d {dec_tbl[static_cast<size_t>(c)]};
-        if (d < 0) throw std::invalid_argument {
-            "trying to decode invalid base64 string : " + std::string{b64str}};
+#undef GH4CK3R_TARGET
+} // namespace ssse3
 
-        auto &q = u.q;
-        constexpr decltype(q.c1) mask = (1<<6)-1;
-        switch (n) {
-            case 0: q.c1 = d & mask; break;
-            case 1: q.c2 = d & mask; break;
-            case 2: q.c3 = d & mask; break;
-            case 3: q.c4 = d & mask; break;
-        }
+namespace avx2 {
+
+#define GH4CK3R_TARGET __attribute__((target("avx2")))
+
+GH4CK3R_TARGET inline __m256i enc_reshuffle(__m256i in) {
+    in = _mm256_shuffle_epi8(in, _mm256_set_epi8(
+            10, 11,  9, 10,  7,  8,  6,  7,  4,  5,  3,  4,  1,  2,  0,  1,
+            10, 11,  9, 10,  7,  8,  6,  7,  4,  5,  3,  4,  1,  2,  0,  1));
+    const auto t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    const auto t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    const auto t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    const auto t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    return _mm256_or_si256(t1, t3);
+}
+
+GH4CK3R_TARGET inline __m256i enc_translate(const __m256i indices) {
+    const auto shift_lut = _mm256_setr_epi8(
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+            '/' - 63, 'A', 0, 0,
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+            '/' - 63, 'A', 0, 0);
+    auto r = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    const auto less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    r = _mm256_or_si256(r, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+    return _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, r), indices);
+}
+
+GH4CK3R_TARGET inline bool dec_translate(__m256i &str) {
+    const auto lut_lo = _mm256_setr_epi8(
+            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+            0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+            0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const auto lut_hi = _mm256_setr_epi8(
+            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const auto lut_roll = _mm256_setr_epi8(
+            0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const auto nibble = _mm256_set1_epi8(0x0f);
+
+    const auto hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), nibble);
+    const auto lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(str, nibble));
+    const auto hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+    if (!_mm256_testz_si256(lo, hi)) return false;
+
+    const auto eq_2f = _mm256_cmpeq_epi8(str, _mm256_set1_epi8('/'));
+    const auto roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+    str = _mm256_add_epi8(str, roll);
+    return true;
+}
+
+// 32 six bit values -> 24 bytes in the lower part
+GH4CK3R_TARGET inline __m256i dec_reshuffle(const __m256i values) {
+    const auto ab_bc = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+    auto out = _mm256_madd_epi16(ab_bc, _mm256_set1_epi32(0x00011000));
+    out = _mm256_shuffle_epi8(out, _mm256_setr_epi8(
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    return _mm256_permutevar8x32_epi32(out, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+}
+
+GH4CK3R_TARGET inline size_t encode(const uint8_t *src, size_t len, char *dst) {
+    const auto out = dst;
+    // Each lane takes 12 bytes out of a 16 bytes load.
+    for (; len >= 12 + 16; len -= 24, src += 24, dst += 32) {
+        const auto in = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i *>(src))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 12)), 1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst),
+                enc_translate(enc_reshuffle(in)));
+    }
+    return static_cast<size_t>(dst - out) + ssse3::encode(src, len, dst);
+}
+
+GH4CK3R_TARGET inline size_t decode(const char *src, size_t len, uint8_t *dst) {
+    const auto out = dst;
+    // 32 bytes are stored for 24 decoded ones; keep 4 quads ahead.
+    for (; len >= 32 + 16; len -= 32, src += 32, dst += 24) {
+        auto str = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+        if (!dec_translate(str)) break;
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), dec_reshuffle(str));
+    }
+    const auto n = ssse3::decode(src, len, dst);
+    return n == npos ? npos : static_cast<size_t>(dst - out) + n;
+}
+
+#undef GH4CK3R_TARGET
+} // namespace avx2
+
+// GCC 12 intrinsics leave the pass-through operand of vpermb undefined.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+namespace avx512vbmi {
+
+#define GH4CK3R_TARGET __attribute__((target("avx512f,avx512bw,avx512vbmi,avx2")))
+
+GH4CK3R_TARGET inline size_t encode(const uint8_t *src, size_t len, char *dst) {
+    const auto out = dst;
+    // [a|b|c] -> [b|a|c|b] per 32 bit word; multishift then picks the four
+    // six bit fields and vpermb translates them through the alphabet.
+    const auto shuffle = _mm512_setr_epi32(
+            0x01020001, 0x04050304, 0x07080607, 0x0a0b090a,
+            0x0d0e0c0d, 0x10110f10, 0x13141213, 0x16171516,
+            0x191a1819, 0x1c1d1b1c, 0x1f201e1f, 0x22232122,
+            0x25262425, 0x28292728, 0x2b2c2a2b, 0x2e2f2d2e);
+    const auto shifts = _mm512_set1_epi64(0x3036242a1016040a);
+    const auto lookup = _mm512_loadu_si512(enc_tbl);
+    for (; len >= 64; len -= 48, src += 48, dst += 64) {
+        const auto in = _mm512_permutexvar_epi8(shuffle, _mm512_loadu_si512(src));
+        const auto indices = _mm512_multishift_epi64_epi8(shifts, in);
+        _mm512_storeu_si512(dst, _mm512_permutexvar_epi8(indices, lookup));
+    }
+    return static_cast<size_t>(dst - out) + avx2::encode(src, len, dst);
+}
+
+GH4CK3R_TARGET inline size_t decode(const char *src, size_t len, uint8_t *dst) {
+    const auto out = dst;
+    // dec_tbl maps invalid characters to -1, so any sign bit in either the
+    // input or the translated value marks the block as invalid.
+    const auto lookup_lo = _mm512_loadu_si512(dec_tbl);
+    const auto lookup_hi = _mm512_loadu_si512(dec_tbl + 64);
+    const auto pack = _mm512_setr_epi32(
+            0x06000102, 0x090a0405, 0x0c0d0e08, 0x16101112,
+            0x191a1415, 0x1c1d1e18, 0x26202122, 0x292a2425,
+            0x2c2d2e28, 0x36303132, 0x393a3435, 0x3c3d3e38,
+            0, 0, 0, 0);
+    // 64 bytes are stored for 48 decoded ones; keep 6 quads ahead.
+    for (; len >= 64 + 24; len -= 64, src += 64, dst += 48) {
+        const auto str = _mm512_loadu_si512(src);
+        const auto values = _mm512_permutex2var_epi8(lookup_lo, str, lookup_hi);
+        if (_mm512_movepi8_mask(_mm512_or_si512(values, str))) break;
+
+        const auto ab_bc = _mm512_maddubs_epi16(values, _mm512_set1_epi32(0x01400140));
+        const auto merged = _mm512_madd_epi16(ab_bc, _mm512_set1_epi32(0x00011000));
+        _mm512_storeu_si512(dst, _mm512_permutexvar_epi8(pack, merged));
+    }
+    const auto n = avx2::decode(src, len, dst);
+    return n == npos ? npos : static_cast<size_t>(dst - out) + n;
+}
+
+#undef GH4CK3R_TARGET
+} // namespace avx512vbmi
+#pragma GCC diagnostic pop
+#endif // GH4CK3R_BASE64_SIMD
 
-        if (n++) ret.insert(ret.end(), u.t[4 - n]);
-        if (!(n %= 4)) u = {{}};
+struct kernel {
+    const char *name;
+    encode_fn encode;
+    decode_fn decode;
+};
+
+inline const kernel &active_kernel() {
+    static const kernel k = [] () -> kernel {
+#ifdef GH4CK3R_BASE64_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("avx512bw"))
+            return {"avx512vbmi", avx512vbmi::encode, avx512vbmi::decode};
+        if (__builtin_cpu_supports("avx2"))
+            return {"avx2", avx2::encode, avx2::decode};
+        if (__builtin_cpu_supports("ssse3"))
+            return {"ssse3", ssse3::encode, ssse3::decode};
+#endif
+        return {"scalar", scalar::encode, scalar::decode};
+    }();
+    return k;
+}
+
+} // namespace detail
+
+/// Encodes `len` bytes from `src` into `dst` which must hold at least
+/// `encoded_size(len)` characters. Returns the number of characters written.
+inline size_t encode_to(const void *src, const size_t len, char *dst) {
+    return detail::active_kernel().encode(static_cast<const uint8_t *>(src), len, dst);
+}
+
+/// Decodes `b64str` into `dst` which must hold at least
+/// `decoded_size(b64str)` bytes. Returns the number of bytes written.
+inline size_t decode_to(const std::string_view b64str, void *dst) {
+    const auto n = detail::active_kernel().decode(
+            b64str.data(), b64str.size(), static_cast<uint8_t *>(dst));
+    if (n == npos) [[unlikely]] throw std::invalid_argument {
+        "trying to decode invalid base64 string : " + std::string{b64str}};
+    return n;
+}
+
+template<class It>
+std::string encode(It beg, const It end)
+{
+    static_assert(1 == sizeof(*beg));
+
+    std::string ret;
+    if constexpr (std::contiguous_iterator<It>) {
+        const auto len = static_cast<size_t>(std::distance(beg, end));
+        ret.resize(encoded_size(len));
+        encode_to(std::to_address(beg), len, ret.data());
+    } else {
+        const std::vector<uint8_t> buf(beg, end);
+        ret.resize(encoded_size(buf.size()));
+        encode_to(buf.data(), buf.size(), ret.data());
     }
     return ret;
 }
 
+template<class T>
+T decode_as(const std::string_view b64str)
+{
+    if constexpr (requires (T &t) {
+        requires sizeof(typename T::value_type) == 1;
+        t.data();
+        t.resize(size_t{});
+    }) {
+        T ret;
+        ret.resize(decoded_size(b64str));
+        ret.resize(decode_to(b64str, ret.data()));
+        return ret;
+    } else {
+        const auto buf = decode_as<std::vector<uint8_t>>(b64str);
+        return T(buf.begin(), buf.end());
+    }
+}
+
 template <class T, class = std::enable_if_t<std::is_object_v<T>>>
 inline std::string encode(T&& data) {
     return encode(begin(std::forward<T>(data)), end(std::forward<T>(data)));
@@ -122,4 +459,210 @@ inline std::string decode(const std::string_view base64_str) {
     return decode_as<decltype(decode(base64_str))>(base64_str);
 }
 
+namespace detail {
+
+template <typename W, typename T>
+concept writer = requires (W &w, const T &chunk) { w.write(chunk); };
+
+// Adapts FileWriter-like objects into a sink; a `false` return is an error.
+template <typename T, typename W>
+std::function<void(T)> to_sink(W &w) {
+    return [&w] (const T chunk) {
+        if constexpr (std::is_convertible_v<decltype(w.write(chunk)), bool>) {
+            if (!w.write(chunk)) [[unlikely]]
+                throw std::runtime_error {"base64: failed to write to sink"};
+        } else {
+            w.write(chunk);
+        }
+    };
+}
+
+} // namespace detail
+
+/// Stateful encoder for input coming in arbitrary sized chunks.
+/// It either writes into caller-provided spans or pushes the output into a
+/// sink through a fixed size buffer.
+class Encoder {
+ public:
+    using sink_t = std::function<void(std::string_view)>;
+    static constexpr size_t default_buf_siz = 64 * 1024;
+
+    Encoder() = default;
+
+    template <typename SINK>
+    requires std::is_invocable_v<SINK&, std::string_view>
+    explicit Encoder(SINK &&sink, const size_t buf_siz = default_buf_siz) :
+        sink_(std::forward<SINK>(sink)),
+        buf_(std::max<size_t>(buf_siz / 4 * 4, 16))
+    {}
+
+    template <detail::writer<std::string_view> W>
+    explicit Encoder(W &w, const size_t buf_siz = default_buf_siz) :
+        Encoder(detail::to_sink<std::string_view>(w), buf_siz)
+    {}
+
+    /// Upper bound of characters `update` writes for `len` bytes.
+    static constexpr size_t max_output(const size_t len) { return encoded_size(len); }
+
+    size_t update(std::span<const uint8_t> in, const std::span<char> out) {
+        if (out.size() < max_output(in.size())) [[unlikely]]
+            throw std::length_error {"base64::Encoder: output span is too small"};
+
+        const auto encode = detail::active_kernel().encode;
+        auto dst = out.data();
+        if (ncarry_) {
+            const auto n = std::min(sizeof(carry_) - ncarry_, in.size());
+            std::copy_n(in.begin(), n, carry_ + ncarry_);
+            in = in.subspan(n);
+            if ((ncarry_ += n) < sizeof(carry_)) return 0;
+
+            dst += encode(carry_, sizeof(carry_), dst);
+            ncarry_ = 0;
+        }
+
+        const auto whole = in.size() / 3 * 3;
+        dst += encode(in.data(), whole, dst);
+        ncarry_ = in.size() - whole;
+        std::copy(in.begin() + static_cast<std::ptrdiff_t>(whole), in.end(), carry_);
+
+        return static_cast<size_t>(dst - out.data());
+    }
+
+    /// Flushes 0-2 pending bytes with padding; `out` needs 4 characters.
+    size_t finalize(const std::span<char> out) {
+        if (!ncarry_) return 0;
+        if (out.size() < 4) [[unlikely]]
+            throw std::length_error {"base64::Encoder: output span is too small"};
+        return detail::active_kernel().encode(carry_, std::exchange(ncarry_, 0), out.data());
+    }
+
+    Encoder &update(const void *data, size_t len) {
+        if (!sink_) [[unlikely]] throw std::logic_error {"base64::Encoder: no sink"};
+
+        auto p = static_cast<const uint8_t *>(data);
+        const auto chunk_siz = buf_.size() / 4 * 3 - 3;
+        while (len) {
+            const auto n = std::min(len, chunk_siz);
+            if (const auto w = update({p, n}, buf_); w) sink_({buf_.data(), w});
+            p += n;
+            len -= n;
+        }
+        return *this;
+    }
+
+    template <typename C> requires requires (const C &c) {
+        requires sizeof(*c.data()) == 1;
+        c.size();
+    }
+    inline Encoder &update(const C &c) { return update(c.data(), c.size()); }
+
+    void finalize() {
+        if (!sink_) [[unlikely]] throw std::logic_error {"base64::Encoder: no sink"};
+        if (const auto w = finalize(buf_); w) sink_({buf_.data(), w});
+    }
+
+ private:
+    sink_t sink_;
+    std::vector<char> buf_;
+    uint8_t carry_[3] {};
+    size_t ncarry_ {0};
+};
+
+/// Stateful decoder counterpart of `Encoder`. Input after the first padding
+/// character is ignored as `decode` does.
+class Decoder {
+ public:
+    using sink_t = std::function<void(std::span<const uint8_t>)>;
+    static constexpr size_t default_buf_siz = 48 * 1024;
+
+    Decoder() = default;
+
+    template <typename SINK>
+    requires std::is_invocable_v<SINK&, std::span<const uint8_t>>
+    explicit Decoder(SINK &&sink, const size_t buf_siz = default_buf_siz) :
+        sink_(std::forward<SINK>(sink)),
+        buf_(std::max<size_t>(buf_siz / 3 * 3, 12))
+    {}
+
+    template <detail::writer<std::span<const uint8_t>> W>
+    explicit Decoder(W &w, const size_t buf_siz = default_buf_siz) :
+        Decoder(detail::to_sink<std::span<const uint8_t>>(w), buf_siz)
+    {}
+
+    /// Upper bound of bytes `update` writes for `len` characters.
+    static constexpr size_t max_output(const size_t len) { return (len + 3) / 4 * 3; }
+
+    size_t update(std::string_view in, const std::span<uint8_t> out) {
+        if (out.size() < max_output(in.size())) [[unlikely]]
+            throw std::length_error {"base64::Decoder: output span is too small"};
+        if (done_) return 0;
+
+        if (const auto pad = in.find('='); pad != in.npos) {
+            in = in.substr(0, pad);
+            done_ = true;
+        }
+
+        const auto decode = [f = detail::active_kernel().decode] (
+                const char *src, size_t len, uint8_t *dst) {
+            const auto n = f(src, len, dst);
+            if (n == npos) [[unlikely]]
+                throw std::invalid_argument {"trying to decode invalid base64 stream"};
+            return n;
+        };
+
+        auto dst = out.data();
+        if (ncarry_) {
+            const auto n = std::min(sizeof(carry_) - ncarry_, in.size());
+            std::copy_n(in.begin(), n, carry_ + ncarry_);
+            in.remove_prefix(n);
+            if ((ncarry_ += n) < sizeof(carry_)) return 0;
+
+            dst += decode(carry_, sizeof(carry_), dst);
+            ncarry_ = 0;
+        }
+
+        const auto whole = in.size() / 4 * 4;
+        dst += decode(in.data(), whole, dst);
+        ncarry_ = in.size() - whole;
+        std::copy(in.begin() + static_cast<std::ptrdiff_t>(whole), in.end(), carry_);
+
+        return static_cast<size_t>(dst - out.data());
+    }
+
+    /// Flushes 0-3 pending characters; `out` needs 2 bytes.
+    size_t finalize(const std::span<uint8_t> out) {
+        if (out.size() < 2) [[unlikely]]
+            throw std::length_error {"base64::Decoder: output span is too small"};
+        const auto n = detail::active_kernel().decode(
+                carry_, std::exchange(ncarry_, 0), out.data());
+        if (n == npos) [[unlikely]]
+            throw std::invalid_argument {"trying to decode invalid base64 stream"};
+        return n;
+    }
+
+    Decoder &update(std::string_view in) {
+        if (!sink_) [[unlikely]] throw std::logic_error {"base64::Decoder: no sink"};
+
+        const auto chunk_siz = buf_.size() / 3 * 4 - 4;
+        while (!in.empty()) {
+            const auto chunk = in.substr(0, chunk_siz);
+            if (const auto w = update(chunk, buf_); w) sink_({buf_.data(), w});
+            in.remove_prefix(chunk.size());
+        }
+        return *this;
+    }
+
+    void finalize() {
+        if (!sink_) [[unlikely]] throw std::logic_error {"base64::Decoder: no sink"};
+        if (const auto w = finalize(buf_); w) sink_({buf_.data(), w});
+    }
+
+ private:
+    sink_t sink_;
+    std::vector<uint8_t> buf_;
+    char carry_[4] {};
+    size_t ncarry_ {0};
+    bool done_ {false};
+};
+
 } // namespace gh4ck3r::base64
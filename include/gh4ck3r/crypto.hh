@@ -1,24 +1,45 @@
 #pragma once
+#include <algorithm>
 #include <array>
+#include <climits>
+#include <concepts>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <limits>
+#include <mutex>
 #include <optional>
+#include <span>
 #include <stdexcept>
+#include <system_error>
+#include <thread>
 #include <vector>
 #include <cuchar>
+#include <openssl/aes.h>
 #include <openssl/err.h>
 #include <openssl/evp.h>
 #include <openssl/provider.h>
 #include <openssl/seed.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "defer.hh"
+#include "file.hh"
 #include "singleton.hh"
 
 namespace gh4ck3r::crypto {
 
 enum class Alg {
   SEED,
+  AES_128,
+  AES_256,
 };
 
 enum class Mode {
   CBC,
+  CTR,
+  GCM,
 };
 
 inline namespace openssl {
@@ -28,6 +49,50 @@ template <> struct Info<Alg::SEED, Mode::CBC> {
   static constexpr auto EVP = EVP_seed_cbc;
   static constexpr size_t block_siz = SEED_BLOCK_SIZE;
   static constexpr size_t key_siz = SEED_KEY_LENGTH;
+  static constexpr size_t iv_siz = SEED_BLOCK_SIZE;
+};
+
+template <> struct Info<Alg::AES_128, Mode::CBC> {
+  static constexpr auto EVP = EVP_aes_128_cbc;
+  static constexpr size_t block_siz = AES_BLOCK_SIZE;
+  static constexpr size_t key_siz = 16;
+  static constexpr size_t iv_siz = AES_BLOCK_SIZE;
+};
+
+template <> struct Info<Alg::AES_256, Mode::CBC> {
+  static constexpr auto EVP = EVP_aes_256_cbc;
+  static constexpr size_t block_siz = AES_BLOCK_SIZE;
+  static constexpr size_t key_siz = 32;
+  static constexpr size_t iv_siz = AES_BLOCK_SIZE;
+};
+
+// `iv_siz` of CTR is the initial counter block
+template <> struct Info<Alg::AES_128, Mode::CTR> {
+  static constexpr auto EVP = EVP_aes_128_ctr;
+  static constexpr size_t block_siz = AES_BLOCK_SIZE;
+  static constexpr size_t key_siz = 16;
+  static constexpr size_t iv_siz = AES_BLOCK_SIZE;
+};
+
+template <> struct Info<Alg::AES_256, Mode::CTR> {
+  static constexpr auto EVP = EVP_aes_256_ctr;
+  static constexpr size_t block_siz = AES_BLOCK_SIZE;
+  static constexpr size_t key_siz = 32;
+  static constexpr size_t iv_siz = AES_BLOCK_SIZE;
+};
+
+template <> struct Info<Alg::AES_128, Mode::GCM> {
+  static constexpr auto EVP = EVP_aes_128_gcm;
+  static constexpr size_t block_siz = AES_BLOCK_SIZE;
+  static constexpr size_t key_siz = 16;
+  static constexpr size_t iv_siz = 12;
+};
+
+template <> struct Info<Alg::AES_256, Mode::GCM> {
+  static constexpr auto EVP = EVP_aes_256_gcm;
+  static constexpr size_t block_siz = AES_BLOCK_SIZE;
+  static constexpr size_t key_siz = 32;
+  static constexpr size_t iv_siz = 12;
 };
 
 struct ERR : std::runtime_error {
@@ -59,7 +124,9 @@ class Provider {
  public:
   Provider() = delete;
   Provider(const char *name) :
-    ossl_provider_(OSSL_PROVIDER_load(libctx_, name))
+    // OSSL_PROVIDER_load() would stop falling back to "default" provider
+    // and leave the other ciphers unavailable.
+    ossl_provider_(OSSL_PROVIDER_try_load(libctx_, name, 1))
   {}
 
   ~Provider() noexcept {
@@ -71,67 +138,220 @@ class Provider {
   OSSL_PROVIDER * const ossl_provider_;
 };
 
+template <Alg alg, Mode mode>
+inline EVP_CIPHER *fetch_cipher() {
+  return EVP_CIPHER_fetch(LIB_CTX {},
+      EVP_CIPHER_get0_name(Info<alg, mode>::EVP()), nullptr);
+}
+
+/// `EVP_CIPHER` fetched once and shared as long as any holds it.
+template <Alg alg, Mode mode>
+using CIPHER = SharedSingleton<EVP_CIPHER, fetch_cipher<alg, mode>, EVP_CIPHER_free>;
+
+namespace detail {
+
+// Contexts of a thread released by `Cipher`s, kept with the cipher they
+// were initialized with. Taking one back saves the cipher lookup and context
+// setup for the next `Cipher`. Providers are loaded by `Cipher`s, not here,
+// so that "legacy" is unloaded along with the last SEED `Cipher`.
+template <Alg alg, Mode mode, bool Encrypt>
+class ctx_pool {
+  static constexpr size_t max_pooled = 8;
+
+ public:
+  ~ctx_pool() noexcept {
+    alive_ = false;
+    for (auto ctx : ctxs_) EVP_CIPHER_CTX_free(ctx);
+  }
+
+  static ctx_pool &local() {
+    thread_local ctx_pool pool;
+    return pool;
+  }
+
+  // Returns `ctx` to the pool of this thread, or frees it if the pool is
+  // gone or was never made, e.g. for a `Cipher` of static storage duration
+  // or one destroyed by another thread_local's destructor.
+  static void recycle(EVP_CIPHER_CTX * const ctx) noexcept {
+    if (alive_) local().release(ctx);
+    else EVP_CIPHER_CTX_free(ctx);
+  }
+
+  inline const EVP_CIPHER *cipher() const { return cipher_; }
+
+  // Context initialized with `cipher()` if any has been released, otherwise
+  // new one.
+  EVP_CIPHER_CTX *acquire() {
+    if (ctxs_.empty()) {
+      if (const auto ctx = EVP_CIPHER_CTX_new(); ctx) [[likely]] return ctx;
+      throw ERR {"Failed to create cipher context"};
+    }
+    const auto ctx = ctxs_.back();
+    ctxs_.pop_back();
+    return ctx;
+  }
+
+  // Keeps `ctx` for the next `acquire()` with its key schedule wiped by an
+  // all zero key, or frees it.
+  void release(EVP_CIPHER_CTX * const ctx) noexcept {
+    static constexpr std::array<uint8_t, Info<alg, mode>::key_siz> zero_key {};
+    if (ctxs_.size() < max_pooled && EVP_CIPHER_CTX_get0_cipher(ctx)
+        && 1 == EVP_CipherInit_ex2(ctx, nullptr, zero_key.data(), nullptr, -1, nullptr))
+    {
+      try {
+        ctxs_.push_back(ctx);
+        return;
+      } catch (...) {}
+    }
+    EVP_CIPHER_CTX_free(ctx);
+  }
+
+ private:
+  ctx_pool() { alive_ = true; }
+
+  // trivially destructible, so that it's readable all along the thread
+  static inline thread_local bool alive_ {false};
+
+  CIPHER<alg, mode> cipher_;
+  std::vector<EVP_CIPHER_CTX *> ctxs_;
+};
+
+} // namespace detail
 
 template <Alg alg, Mode mode, bool Encrypt>
 class Cipher {
-  std::optional<Provider> ossl_provider_;
+  using pool = detail::ctx_pool<alg, mode, Encrypt>;
+
+  // loaded ahead of the pool fetching its cipher from it
+  std::optional<Provider> ossl_provider_ {[] () -> std::optional<Provider> {
+    if constexpr (alg == Alg::SEED) return std::optional<Provider> {std::in_place, "legacy"};
+    return std::nullopt;
+  }()};
 
  public:
   using KEY = std::array<uint8_t, Info<alg, mode>::key_siz>;
-  using IV  = std::array<uint8_t, Info<alg, mode>::block_siz>;
+  using IV  = std::array<uint8_t, Info<alg, mode>::iv_siz>;
+  using TAG = std::array<uint8_t, EVP_GCM_TLS_TAG_LEN>;
 
   explicit Cipher(const KEY &key = {0, }, const IV &iv = {0, }) :
-    ctx_(EVP_CIPHER_CTX_new()),
+    ctx_(pool::local().acquire()),
     outbuf_offset_(0)
   {
-    if constexpr (alg == Alg::SEED) { ossl_provider_.emplace("legacy"); }
-
-    constexpr auto EVP_CryptInit = Encrypt ? EVP_EncryptInit : EVP_DecryptInit;
-    EVP_CryptInit(ctx_, Info<alg, mode>::EVP(), key.data(), iv.data());
+    // a pooled context keeps its cipher, which needs only new key and IV.
+    const auto cipher = EVP_CIPHER_CTX_get0_cipher(ctx_) ? nullptr : pool::local().cipher();
+    if (1 != EVP_CipherInit_ex2(ctx_, cipher, key.data(), iv.data(), Encrypt ? 1 : 0, nullptr)) {
+      pool::local().release(ctx_);
+      throw ERR {"Failed to initialize context"};
+    }
   }
 
+  Cipher(const Cipher&) = delete;
+  Cipher& operator=(const Cipher&) = delete;
+
   ~Cipher() noexcept {
-    EVP_CIPHER_CTX_free(ctx_);
+    pool::recycle(ctx_);
   }
 
-  auto &update(const uint8_t *data, size_t len) {
-    if (outbuf_.size() - outbuf_offset_ < len) {
-      outbuf_.resize(std::max(outbuf_.capacity(), len) << 1);
-    }
+  /// Starts over with new `key` and `iv` on the same context, dropping
+  /// whatever was in progress.
+  auto &reset(const KEY &key, const IV &iv = {0, }) {
+    if (1 != EVP_CipherInit_ex2(ctx_, nullptr, key.data(), iv.data(), Encrypt ? 1 : 0, nullptr))
+      throw ERR {"Failed to reset context"};
+    outbuf_.clear();
+    outbuf_offset_ = 0;
+    return *this;
+  }
+
+  /// Upper bound of output of `update()` for `len` bytes of input and of
+  /// `finalize()` for 0. Stream-like modes (CTR, GCM) never hold input back.
+  static constexpr size_t max_output(const size_t len) {
+    return mode == Mode::CBC ? len + Info<alg, mode>::block_siz : len;
+  }
+
+  /// Runs `in` through the cipher into caller-owned `out`, which holds at
+  /// least `max_output(in.size())` bytes, and returns the number of bytes
+  /// written. `out` may start at `in` for in place update: on every call
+  /// for CTR and GCM, but for CBC only in a single update of the whole
+  /// input with `out` running `block_siz` bytes past the end of `in`.
+  size_t update(std::span<const uint8_t> in, const std::span<uint8_t> out) {
+    if (out.size() < max_output(in.size())) [[unlikely]]
+      throw std::invalid_argument {"output buffer is too small"};
 
     const auto int_cutoff = [] (const size_t &n) {
       return static_cast<int>(
           std::min(n, static_cast<size_t>(std::numeric_limits<int>::max())));
     };
-    for (auto cipherlen = int_cutoff(len);
+    size_t nout = 0;
+    for (auto cipherlen = int_cutoff(in.size());
         cipherlen;
-        cipherlen = int_cutoff(len -= static_cast<size_t>(cipherlen)))
+        cipherlen = int_cutoff(in.size()))
     {
       int32_t outl;
       constexpr auto EVP_CryptUpdate = Encrypt ? EVP_EncryptUpdate : EVP_DecryptUpdate;
       if (1 != EVP_CryptUpdate(ctx_,
-            outbuf_.data() + outbuf_offset_,
+            out.data() + nout,
             &outl,
-            data,
+            in.data(),
             cipherlen))
       {
         throw ERR {"Failed to update cipher"};
       }
+      nout += static_cast<size_t>(outl);
+      in = in.subspan(static_cast<size_t>(cipherlen));
     }
-    return *this;
+    return nout;
   }
 
-  const auto &finalize() {
+  /// Writes the rest to `out` of at least `max_output(0)` bytes and returns
+  /// the number of bytes written.
+  size_t finalize(const std::span<uint8_t> out) {
+    if (out.size() < max_output(0)) [[unlikely]]
+      throw std::invalid_argument {"output buffer is too small"};
+
     int32_t outl;
     constexpr auto EVP_CryptFinal = Encrypt ? EVP_EncryptFinal_ex : EVP_DecryptFinal_ex;
-    if (1 != EVP_CryptFinal(ctx_, outbuf_.data() + outbuf_offset_, &outl))
+    if (1 != EVP_CryptFinal(ctx_, out.data(), &outl))
       throw ERR {"Failed to finalize"};
-    outbuf_offset_ += static_cast<size_t>(outl);
+    return static_cast<size_t>(outl);
+  }
+
+  auto &update(const uint8_t *data, size_t len) {
+    if (outbuf_.size() - outbuf_offset_ < max_output(len)) {
+      outbuf_.resize(std::max(outbuf_.size() << 1, outbuf_offset_ + max_output(len)));
+    }
+    outbuf_offset_ += update({data, len}, std::span {outbuf_}.subspan(outbuf_offset_));
+    return *this;
+  }
+
+  const auto &finalize() {
+    if (outbuf_.size() - outbuf_offset_ < max_output(0)) {
+      outbuf_.resize(outbuf_offset_ + max_output(0));
+    }
+    outbuf_offset_ += finalize(std::span {outbuf_}.subspan(outbuf_offset_));
     outbuf_.resize(outbuf_offset_);
     outbuf_.shrink_to_fit();
     return outbuf_;
   }
 
+  /// Authentication tag of GCM; available after `finalize()` of encryption
+  /// and to be given before `finalize()` of decryption.
+  auto tag() const requires (mode == Mode::GCM && Encrypt) {
+    TAG tag;
+    if (1 != EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_AEAD_GET_TAG, tag.size(), tag.data()))
+      throw ERR {"Failed to get tag"};
+    return tag;
+  }
+  auto &tag(const TAG &tag)
+    requires (mode == Mode::GCM && !Encrypt)
+  {
+    if (1 != EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_AEAD_SET_TAG, tag.size(),
+          const_cast<uint8_t *>(tag.data())))
+    {
+      throw ERR {"Failed to set tag"};
+    }
+    return *this;
+  }
+
  private:
   EVP_CIPHER_CTX * const ctx_;
   std::vector<uint8_t> outbuf_;
@@ -157,7 +377,8 @@ class Cipher {
 
  public:
   using KEY = std::array<uint8_t, Info<alg, mode>::key_siz>;
-  using IV  = std::array<uint8_t, Info<alg, mode>::block_siz>;
+  using IV  = std::array<uint8_t, Info<alg, mode>::iv_siz>;
+  using TAG = std::array<uint8_t, EVP_GCM_TLS_TAG_LEN>;
   explicit Cipher(const KEY &key = {0, }, const IV &iv = {0, }) :
     ctx_(EVP_CIPHER_CTX_new()),
     outbuf_offset_(0)
@@ -178,42 +399,94 @@ class Cipher {
 
   ~Cipher() { EVP_CIPHER_CTX_free(ctx_); }
 
-  auto &update(const uint8_t *data, size_t len) {
-    if (outbuf_.size() - outbuf_offset_ < len) {
-      outbuf_.resize(std::max(outbuf_.capacity(), len) << 1);
-    }
+  /// Upper bound of output of `update()` for `len` bytes of input and of
+  /// `finalize()` for 0. Stream-like modes (CTR, GCM) never hold input back.
+  static constexpr size_t max_output(const size_t len) {
+    return mode == Mode::CBC ? len + Info<alg, mode>::block_siz : len;
+  }
+
+  /// Runs `in` through the cipher into caller-owned `out`, which holds at
+  /// least `max_output(in.size())` bytes, and returns the number of bytes
+  /// written. `out` may start at `in` for in place update: on every call
+  /// for CTR and GCM, but for CBC only in a single update of the whole
+  /// input with `out` running `block_siz` bytes past the end of `in`.
+  size_t update(std::span<const uint8_t> in, const std::span<uint8_t> out) {
+    if (out.size() < max_output(in.size())) [[unlikely]]
+      throw std::invalid_argument {"output buffer is too small"};
 
     const auto int_cutoff = [] (const size_t &n) {
       return static_cast<int>(
           std::min(n, static_cast<size_t>(std::numeric_limits<int>::max())));
     };
-    for (auto cipherlen = int_cutoff(len);
+    size_t nout = 0;
+    for (auto cipherlen = int_cutoff(in.size());
         cipherlen;
-        cipherlen = int_cutoff(len -= static_cast<size_t>(cipherlen)))
+        cipherlen = int_cutoff(in.size()))
     {
       int32_t outl;
       if (1 != EVP_CipherUpdate(ctx_,
-            outbuf_.data() + outbuf_offset_,
+            out.data() + nout,
             &outl,
-            data,
+            in.data(),
             cipherlen))
       {
         throw ERR {"Failed to update cipher"};
       }
+      nout += static_cast<size_t>(outl);
+      in = in.subspan(static_cast<size_t>(cipherlen));
     }
-    return *this;
+    return nout;
   }
 
-  const auto &finalize() {
+  /// Writes the rest to `out` of at least `max_output(0)` bytes and returns
+  /// the number of bytes written.
+  size_t finalize(const std::span<uint8_t> out) {
+    if (out.size() < max_output(0)) [[unlikely]]
+      throw std::invalid_argument {"output buffer is too small"};
+
     int32_t outl;
-    if (1 != EVP_CipherFinal(ctx_, outbuf_.data() + outbuf_offset_, &outl))
+    if (1 != EVP_CipherFinal(ctx_, out.data(), &outl))
       throw ERR {"Failed to finalize"};
-    outbuf_offset_ += static_cast<size_t>(outl);
+    return static_cast<size_t>(outl);
+  }
+
+  auto &update(const uint8_t *data, size_t len) {
+    if (outbuf_.size() - outbuf_offset_ < max_output(len)) {
+      outbuf_.resize(std::max(outbuf_.size() << 1, outbuf_offset_ + max_output(len)));
+    }
+    outbuf_offset_ += update({data, len}, std::span {outbuf_}.subspan(outbuf_offset_));
+    return *this;
+  }
+
+  const auto &finalize() {
+    if (outbuf_.size() - outbuf_offset_ < max_output(0)) {
+      outbuf_.resize(outbuf_offset_ + max_output(0));
+    }
+    outbuf_offset_ += finalize(std::span {outbuf_}.subspan(outbuf_offset_));
     outbuf_.resize(outbuf_offset_);
     outbuf_.shrink_to_fit();
     return outbuf_;
   }
 
+  /// Authentication tag of GCM; available after `finalize()` of encryption
+  /// and to be given before `finalize()` of decryption.
+  auto tag() const requires (mode == Mode::GCM && Encrypt) {
+    TAG tag;
+    if (1 != EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_AEAD_GET_TAG, tag.size(), tag.data()))
+      throw ERR {"Failed to get tag"};
+    return tag;
+  }
+  auto &tag(const TAG &tag)
+    requires (mode == Mode::GCM && !Encrypt)
+  {
+    if (1 != EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_AEAD_SET_TAG, tag.size(),
+          const_cast<uint8_t *>(tag.data())))
+    {
+      throw ERR {"Failed to set tag"};
+    }
+    return *this;
+  }
+
  private:
   EVP_CIPHER_CTX * const ctx_;
   std::vector<uint8_t> outbuf_;
@@ -228,6 +501,358 @@ using Decryptor = v1::Cipher<alg, mode, false>;
 
 } // namespace v1
 
+namespace detail {
+
+// Adds `n` to big endian counter block `ctr`.
+template <size_t N>
+void ctr_add(std::array<uint8_t, N> &ctr, uint64_t n) {
+  for (auto i = N; i-- && n; n >>= 8) {
+    n += ctr[i];
+    ctr[i] = static_cast<uint8_t>(n);
+  }
+}
+
+// Runs `len` bytes from `in` through a context of its own and returns the
+// number of bytes written to `out`, which may be `in`. Only the `last`
+// segment is padded/finalized.
+inline size_t crypt_segment(const EVP_CIPHER * const evp,
+    const uint8_t * const key, const uint8_t * const iv,
+    const uint8_t * const in, const size_t len, uint8_t * const out,
+    const bool encrypt, const bool last)
+{
+  const auto ctx = EVP_CIPHER_CTX_new();
+  if (!ctx) throw ERR {"Failed to create cipher context"};
+  const Defer free_ctx {[ctx] { EVP_CIPHER_CTX_free(ctx); }};
+
+  if (1 != EVP_CipherInit_ex(ctx, evp, nullptr, key, iv, encrypt ? 1 : 0))
+    throw ERR {"Failed to initialize context"};
+  if (!last) EVP_CIPHER_CTX_set_padding(ctx, 0);
+
+  // block aligned chunks as in place update requires
+  constexpr size_t max_chunk = (INT_MAX / 2) & ~size_t{0xff};
+  size_t nout = 0;
+  for (size_t off = 0; off < len;) {
+    const auto n = std::min(len - off, max_chunk);
+    int outl;
+    if (1 != EVP_CipherUpdate(ctx, out + nout, &outl, in + off, static_cast<int>(n)))
+      throw ERR {"Failed to update cipher"};
+    off += n;
+    nout += static_cast<size_t>(outl);
+  }
+  if (last) {
+    int outl;
+    if (1 != EVP_CipherFinal_ex(ctx, out + nout, &outl)) throw ERR {"Failed to finalize"};
+    nout += static_cast<size_t>(outl);
+  }
+  return nout;
+}
+
+// Splits `in` into block aligned segments and runs each on its own thread
+// with its own context. Segments are independent as CBC decryption takes
+// the previous ciphertext block as IV, and CTR the advanced counter.
+template <Alg alg, Mode mode, bool Encrypt>
+size_t crypt_parallel(
+    const std::array<uint8_t, Info<alg, mode>::key_siz> &key,
+    const std::array<uint8_t, Info<alg, mode>::iv_siz> &iv,
+    const std::span<const uint8_t> in, const std::span<uint8_t> out,
+    unsigned nthreads)
+{
+  static_assert(mode == Mode::CTR || (mode == Mode::CBC && !Encrypt),
+      "Only CBC decryption and CTR can run in parallel");
+  constexpr size_t block_siz = Info<alg, mode>::block_siz;
+  constexpr size_t min_segment_siz = 64 * 1024;
+
+  if (out.size() < in.size()) [[unlikely]]
+    throw std::invalid_argument {"output is shorter than input"};
+  if (mode == Mode::CBC && in.size() % block_siz) [[unlikely]]
+    throw std::invalid_argument {"ciphertext isn't multiple of block size"};
+
+#if OPENSSL_VERSION_NUMBER >= 0x030000000 // 3.0.0
+  std::optional<v3::Provider> ossl_provider;
+  if constexpr (alg == Alg::SEED) ossl_provider.emplace("legacy");
+  const v3::CIPHER<alg, mode> evp;
+#else
+  const auto evp = Info<alg, mode>::EVP();
+#endif
+
+  if (!nthreads) nthreads = std::max(1u, std::thread::hardware_concurrency());
+  const auto nblocks = (in.size() + block_siz - 1) / block_siz;
+  const auto nworkers = std::clamp<size_t>(in.size() / min_segment_siz, 1, nthreads);
+  const auto seg_blocks = std::max<size_t>(1, (nblocks + nworkers - 1) / nworkers);
+  const auto nseg = std::max<size_t>(1, (nblocks + seg_blocks - 1) / seg_blocks);
+
+  // IVs are taken before any segment overwrites its input in place.
+  std::vector<std::array<uint8_t, Info<alg, mode>::iv_siz>> ivs(nseg, iv);
+  for (size_t i = 1; i < nseg; ++i) {
+    if constexpr (mode == Mode::CBC) {
+      std::memcpy(ivs[i].data(), in.data() + i * seg_blocks * block_siz - block_siz, block_siz);
+    } else {
+      ctr_add(ivs[i], i * seg_blocks);
+    }
+  }
+
+  std::vector<std::exception_ptr> errors(nseg);
+  size_t nout = 0;
+  const auto run = [&] (const size_t i) {
+    try {
+      const auto off = std::min(i * seg_blocks * block_siz, in.size());
+      const auto len = std::min(seg_blocks * block_siz, in.size() - off);
+      const auto last = i + 1 == nseg;
+      const auto n = crypt_segment(evp, key.data(), ivs[i].data(),
+          in.data() + off, len, out.data() + off, Encrypt, last);
+      if (last) nout = off + n;
+    } catch (...) {
+      errors[i] = std::current_exception();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(nseg - 1);
+  // joins those started so far if starting another throws
+  Defer join {[&workers] { for (auto &w : workers) w.join(); }};
+  for (size_t i = 1; i < nseg; ++i) workers.emplace_back(run, i);
+  run(0);
+  join();
+
+  for (const auto &e : errors) if (e) std::rethrow_exception(e);
+  return nout;
+}
+
+} // namespace detail
+
+/// Decrypts `in` into `out`, which may be the same buffer, by up to
+/// `nthreads` threads (0 for all cores). Returns the size of plaintext.
+template <Alg alg, Mode mode>
+inline size_t decrypt_parallel(
+    const std::array<uint8_t, Info<alg, mode>::key_siz> &key,
+    const std::array<uint8_t, Info<alg, mode>::iv_siz> &iv,
+    const std::span<const uint8_t> in, const std::span<uint8_t> out,
+    const unsigned nthreads = 0)
+{
+  return detail::crypt_parallel<alg, mode, false>(key, iv, in, out, nthreads);
+}
+
+/// Counterpart of `decrypt_parallel()` for CTR.
+template <Alg alg, Mode mode>
+inline size_t encrypt_parallel(
+    const std::array<uint8_t, Info<alg, mode>::key_siz> &key,
+    const std::array<uint8_t, Info<alg, mode>::iv_siz> &iv,
+    const std::span<const uint8_t> in, const std::span<uint8_t> out,
+    const unsigned nthreads = 0)
+{
+  return detail::crypt_parallel<alg, mode, true>(key, iv, in, out, nthreads);
+}
+
+namespace detail {
+
+// Blocking queue between stages of `crypt_stream()`. `close()` lets the
+// consumer drain what's left, `cancel()` stops both ends at once.
+template <typename T>
+class channel {
+ public:
+  void push(T v) {
+    {
+      std::lock_guard lock {m_};
+      if (cancelled_) return;
+      q_.push_back(std::move(v));
+    }
+    cv_.notify_one();
+  }
+
+  std::optional<T> pop() {
+    std::unique_lock lock {m_};
+    cv_.wait(lock, [this] { return !q_.empty() || closed_; });
+    if (q_.empty()) return std::nullopt;
+    auto v = std::move(q_.front());
+    q_.pop_front();
+    return v;
+  }
+
+  void close() {
+    {
+      std::lock_guard lock {m_};
+      closed_ = true;
+    }
+    cv_.notify_all();
+  }
+
+  void cancel() {
+    {
+      std::lock_guard lock {m_};
+      closed_ = cancelled_ = true;
+      q_.clear();
+    }
+    cv_.notify_all();
+  }
+
+ private:
+  std::mutex m_;
+  std::condition_variable cv_;
+  std::deque<T> q_;
+  bool closed_ {false};
+  bool cancelled_ {false};
+};
+
+struct chunk {
+  std::vector<uint8_t> buf;
+  size_t len;
+};
+
+// Same as `read_fully` but gives up, returning nullopt, once `stopfd`
+// turns readable, so that a reader blocked on a pipe or socket can be
+// cancelled.
+inline std::optional<size_t> read_fully_until(const int fd, const int stopfd,
+    uint8_t *buf, const size_t len)
+{
+  size_t nread = 0;
+  while (nread < len) {
+    struct pollfd pfds[] {{fd, POLLIN, 0}, {stopfd, POLLIN, 0}};
+    if (::poll(pfds, 2, -1) == -1) {
+      if (errno == EINTR) continue;
+      throw std::system_error {errno, std::system_category(), "poll"};
+    }
+    if (pfds[1].revents) return std::nullopt;
+
+    const auto r = ::read(fd, buf + nread, len - nread);
+    if (r == 0) break;
+    if (r < 0) {
+      if (errno == EINTR || errno == EAGAIN) continue;
+      throw std::system_error {errno, std::system_category(), "failed to read"};
+    }
+    nread += static_cast<size_t>(r);
+  }
+  return nread;
+}
+
+template <typename W>
+concept writer = requires (W &w, const uint8_t *p, size_t l) {
+  { w.write(p, l) } -> std::convertible_to<bool>;
+};
+
+} // namespace detail
+
+/// Runs what's read from `src` through `cipher` and writes the result to
+/// `dst`, a `FileWriter` or file descriptor, then finalizes `cipher`. Reading
+/// and writing run on threads of their own while the calling thread runs the
+/// cipher, handing over chunks of `chunk_siz` through two buffers each, so
+/// memory use stays constant.
+/// `src` is either file descriptor or memory like `mapped_file`, of which
+/// chunks go to the cipher without copy. A reader waiting on a pipe or
+/// socket is woken up when another stage fails. Returns the number of bytes
+/// written.
+template <class CIPHER, typename SRC, typename DST>
+  requires (std::same_as<SRC, int> || std::convertible_to<const SRC&, std::span<const uint8_t>>)
+    && (std::same_as<std::remove_cv_t<DST>, int> || detail::writer<DST>)
+size_t crypt_stream(CIPHER &cipher, const SRC &src, DST &dst,
+    const size_t chunk_siz = 1024 * 1024)
+{
+  if (!chunk_siz) [[unlikely]] throw std::invalid_argument {"zero sized chunk"};
+
+  constexpr auto nbuf = 2;
+  detail::channel<std::vector<uint8_t>> in_free, out_free;
+  detail::channel<detail::chunk> in_full, out_full;
+  for (int i = 0; i < nbuf; ++i) {
+    if constexpr (std::same_as<SRC, int>) in_free.push(std::vector<uint8_t>(chunk_siz));
+    out_free.push(std::vector<uint8_t>(CIPHER::max_output(chunk_siz)));
+  }
+
+  // wakes up the reader blocked on `src`
+  std::optional<filesystem::unique_fd> stopfd;
+  if constexpr (std::same_as<SRC, int>) {
+    const auto fd = ::eventfd(0, EFD_CLOEXEC);
+    if (fd == -1) [[unlikely]] throw std::system_error {errno, std::system_category(), "eventfd"};
+    stopfd.emplace(fd);
+  }
+
+  std::exception_ptr errors[3];
+  const auto cancel = [&] {
+    for (auto ch : {&in_free, &out_free}) ch->cancel();
+    for (auto ch : {&in_full, &out_full}) ch->cancel();
+    if (stopfd) ::eventfd_write(*stopfd, 1);
+  };
+
+  size_t nwritten = 0;
+  std::thread reader, writer;
+  // stops and joins the thread started so far if starting another throws
+  Defer stop {[&] {
+    cancel();
+    for (auto t : {&reader, &writer}) if (t->joinable()) t->join();
+  }};
+
+  if constexpr (std::same_as<SRC, int>) {
+    reader = std::thread {[&] {
+      try {
+        for (auto buf = in_free.pop(); buf; buf = in_free.pop()) {
+          const auto n = detail::read_fully_until(src, *stopfd, buf->data(), buf->size());
+          if (!n) return;
+          if (*n) in_full.push({std::move(*buf), *n});
+          if (*n < chunk_siz) break;
+        }
+        in_full.close();
+      } catch (...) {
+        errors[0] = std::current_exception();
+        cancel();
+      }
+    }};
+  }
+
+  writer = std::thread {[&] {
+    try {
+      for (auto c = out_full.pop(); c; c = out_full.pop()) {
+        bool ok;
+        if constexpr (std::same_as<std::remove_cv_t<DST>, int>) {
+          struct iovec iov { c->buf.data(), c->len };
+          ok = filesystem::detail::write_all(dst, &iov, 1);
+        } else {
+          ok = dst.write(c->buf.data(), c->len);
+        }
+        if (!ok) throw std::system_error {errno, std::system_category(), "failed to write"};
+        nwritten += c->len;
+        out_free.push(std::move(c->buf));
+      }
+    } catch (...) {
+      errors[2] = std::current_exception();
+      cancel();
+    }
+  }};
+  stop.release();
+
+  const auto crypt = [&] (const std::span<const uint8_t> in) {
+    auto out = out_free.pop();
+    if (!out) return false;
+    const auto n = cipher.update(in, *out);
+    out_full.push({std::move(*out), n});
+    return true;
+  };
+  try {
+    if constexpr (std::same_as<SRC, int>) {
+      for (auto c = in_full.pop(); c; c = in_full.pop()) {
+        if (!crypt(std::span {c->buf}.first(c->len))) break;
+        in_free.push(std::move(c->buf));
+      }
+    } else {
+      const std::span<const uint8_t> mem = src;
+      for (size_t off = 0; off < mem.size(); off += chunk_siz) {
+        if (!crypt(mem.subspan(off, std::min(chunk_siz, mem.size() - off)))) break;
+      }
+    }
+    // nothing to take when cancelled by the others
+    if (auto out = out_free.pop(); out) {
+      const auto n = cipher.finalize(*out);
+      out_full.push({std::move(*out), n});
+    }
+    out_full.close();
+  } catch (...) {
+    errors[1] = std::current_exception();
+    cancel();
+  }
+
+  if (reader.joinable()) reader.join();
+  writer.join();
+  for (const auto &e : errors) if (e) std::rethrow_exception(e);
+  return nwritten;
+}
+
 } // namespace openssl
 
 } // namespace gh4ck3r::crypto
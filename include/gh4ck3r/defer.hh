@@ -1,29 +1,114 @@
 #pragma once
+#include <concepts>
+#include <cstddef>
 #include <functional>
-#include <utility>
+#include <new>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
 
 namespace gh4ck3r {
 
-struct Defer : protected std::function<void()> {
+/// Invokes the callable on scope exit. The callable is stored inline as `F`,
+/// which is deduced from the constructor argument. `Defer<>` keeps it in
+/// `std::function<void()>` so that it can be replaced by assignment.
+template <typename F = std::function<void()>>
+class Defer {
+ public:
   Defer() = delete;
-  using base_t = function;
+  Defer(const Defer&) = delete;
+  Defer& operator=(const Defer&) = delete;
+
+  template <class FN>
+    requires std::constructible_from<F, FN>
+  explicit Defer(FN&& fn) : fn_(std::forward<FN>(fn)) {}
+  ~Defer() noexcept { if (engaged()) try {fn_();} catch(...){} }
+
+  template <class FN>
+    requires (!std::same_as<std::remove_cvref_t<FN>, Defer>) && std::assignable_from<F&, FN>
+  inline Defer& operator=(FN&& fn) {
+    fn_ = std::forward<FN>(fn);
+    armed_ = true;
+    return *this;
+  }
+
+  inline void release() { armed_ = false; }
+  inline void operator()() {
+    if (!engaged()) [[unlikely]] throw std::logic_error {"Defer object is empty"};
+    armed_ = false;
+    fn_();
+  }
+
+ private:
+  inline bool engaged() const {
+    if constexpr (std::is_constructible_v<bool, const F&>) {
+      return armed_ && static_cast<bool>(fn_);
+    } else {
+      return armed_;
+    }
+  }
+
+  F fn_;
+  bool armed_ {true};
+};
+
+template <class FN>
+Defer(FN) -> Defer<FN>;
+
+/// Type erased `Defer` for callables up to `N` bytes. Unlike `Defer<>` it
+/// never allocates; a callable that doesn't fit fails to compile.
+template <size_t N = 4 * sizeof(void*)>
+class InplaceDefer {
+ public:
+  InplaceDefer() = delete;
+  InplaceDefer(const InplaceDefer&) = delete;
+  InplaceDefer& operator=(const InplaceDefer&) = delete;
 
   template <class FN>
-  explicit Defer(FN&& fn) : base_t(std::forward<FN>(fn)) {}
-  ~Defer() noexcept { if (*this) try {base_t::operator()();} catch(...){} }
+    requires (!std::same_as<std::remove_cvref_t<FN>, InplaceDefer>)
+  explicit InplaceDefer(FN&& fn) { emplace(std::forward<FN>(fn)); }
+  ~InplaceDefer() noexcept {
+    if (invoke_) try {invoke_(buf_);} catch(...){}
+    reset();
+  }
 
-  using base_t::operator=;
+  template <class FN>
+    requires (!std::same_as<std::remove_cvref_t<FN>, InplaceDefer>)
+  inline InplaceDefer& operator=(FN&& fn) {
+    reset();
+    emplace(std::forward<FN>(fn));
+    return *this;
+  }
 
-  inline void release() { *this = nullptr; }
+  inline void release() { reset(); }
   inline void operator()() {
-    if (!*this) [[unlikely]] throw std::logic_error {"Defer object is empty"};
+    if (!invoke_) [[unlikely]] throw std::logic_error {"Defer object is empty"};
+    const auto invoke = std::exchange(invoke_, nullptr);
+    const Defer destroy {[this] { reset(); }};
+    invoke(buf_);
+  }
+
+ private:
+  template <class FN>
+  void emplace(FN&& fn) {
+    using T = std::decay_t<FN>;
+    static_assert(std::is_invocable_v<T&>, "callable should take no argument");
+    static_assert(sizeof(T) <= N, "callable is too large for InplaceDefer");
+    static_assert(alignof(T) <= alignof(std::max_align_t), "callable is over-aligned");
 
-    base_t f{};
-    swap(f);
+    ::new (static_cast<void*>(buf_)) T(std::forward<FN>(fn));
+    invoke_ = [] (void *p) { std::invoke(*std::launder(static_cast<T*>(p))); };
+    destroy_ = [] (void *p) { std::launder(static_cast<T*>(p))->~T(); };
+  }
 
-    f();
+  inline void reset() {
+    invoke_ = nullptr;
+    if (destroy_) std::exchange(destroy_, nullptr)(buf_);
   }
+
+  alignas(std::max_align_t) std::byte buf_[N];
+  void (*invoke_)(void*) {nullptr};
+  void (*destroy_)(void*) {nullptr};
 };
 
 } // namespace gh4ck3r
@@ -1,24 +1,50 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <ios>
 #include <iostream>
 #include <iterator>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <span>
 #include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
 #include <utility>
 #include <vector>
 #include <cstdlib>
 #include <cstring>
+#include <climits>
+#include <dirent.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
+#include <linux/fs.h>
+#include <linux/io_uring.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 
 namespace gh4ck3r::filesystem {
 using namespace std::filesystem;
 using path_t = std::filesystem::path;
 
 using fd_t = int;
+using stat_t = struct ::stat;
 
 inline bool is_valid(const fd_t fd) {
   // fcntl returns -1 on error. If errno is EBADF, the fd is closed/invalid.
@@ -36,9 +62,10 @@ class unique_fd {
     if (!is_valid(fd_)) throw std::invalid_argument {
       "unique_fd: invalid fd: " + std::to_string(fd_)};
   }
-  unique_fd(unique_fd&& uf) { *this = std::move(uf); }
+  unique_fd(unique_fd&& uf) : fd_(std::exchange(uf.fd_, uninitialized)) {}
   unique_fd& operator=(unique_fd&& rhs) {
-    close(std::exchange(rhs.fd_, uninitialized));
+    if (this != &rhs) [[likely]]
+      close(std::exchange(fd_, std::exchange(rhs.fd_, uninitialized)));
     return *this;
   }
   ~unique_fd() noexcept { close(fd_); }
@@ -52,6 +79,8 @@ class unique_fd {
 
  private:
   static inline void close(fd_t fd) noexcept {
+    if (fd == uninitialized) return;
+
     int rv;
     do {
       rv = ::close(fd);
@@ -64,24 +93,449 @@ class unique_fd {
   static inline constexpr fd_t uninitialized = -1;
 };
 
-template <typename R = std::vector<uint8_t>>
-R load_file(const path_t &p) {
+/// Region of a file holding data, i.e. not a hole.
+struct extent {
+  size_t off;
+  size_t len;
+
+  inline bool operator==(const extent&) const = default;
+};
+
+/// Data regions of the first `siz` bytes of `fd` as lseek(2) with
+/// SEEK_DATA/SEEK_HOLE reports them; a filesystem without hole support
+/// gives the whole file. The file offset of `fd` is left changed.
+inline std::vector<extent> data_extents(const fd_t fd, const size_t siz) {
+  std::vector<extent> ret;
+  for (off_t off = 0; static_cast<size_t>(off) < siz;) {
+    const auto data = ::lseek(fd, off, SEEK_DATA);
+    if (data == -1) {
+      if (errno == ENXIO) break;      // only a hole is left
+      if (errno == EINVAL) return {{static_cast<size_t>(off), siz - static_cast<size_t>(off)}};
+      throw std::system_error {errno, std::system_category(), "lseek(SEEK_DATA)"};
+    }
+    if (static_cast<size_t>(data) >= siz) break;
+    auto hole = ::lseek(fd, data, SEEK_HOLE);
+    if (hole == -1) [[unlikely]]
+      throw std::system_error {errno, std::system_category(), "lseek(SEEK_HOLE)"};
+    hole = std::min(hole, static_cast<off_t>(siz));
+    ret.push_back({static_cast<size_t>(data), static_cast<size_t>(hole - data)});
+    off = hole;
+  }
+  return ret;
+}
+
+namespace detail {
+
+// Opens `p` for reading after making sure it is a regular file, so devices,
+// FIFOs and sockets are never opened. The size is taken via fstat(2) on the
+// opened descriptor.
+inline std::pair<unique_fd, stat_t> open_regular(const path_t &p) {
   if (const auto &stat = status(p); is_directory(stat)) [[unlikely]]
     throw std::invalid_argument {"directory can't be loaded: " + p.string()};
   else if (!is_regular_file(stat)) [[unlikely]]
     throw std::invalid_argument {"file not found: " + p.string()};
 
-  std::ifstream is {p, std::ios::binary};
-  is.unsetf(std::ios::skipws);
-  return {std::istream_iterator<uint8_t>{is}, std::istream_iterator<uint8_t>{}};
+  const auto fd = ::open(p.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) [[unlikely]] throw std::system_error {
+    errno, std::system_category(), "failed to open " + p.string()};
+
+  std::pair<unique_fd, stat_t> ret {unique_fd {fd}, stat_t {}};
+  if (::fstat(ret.first, &ret.second) == -1) [[unlikely]]
+    throw std::system_error {errno, std::system_category(),
+      "failed to stat " + p.string()};
+
+  return ret;
+}
+
+// Reads from current offset of `fd` into `buf` until it is full or EOF.
+inline size_t read_fully(const fd_t fd, uint8_t *buf, const size_t len) {
+  size_t nread = 0;
+  while (nread < len) {
+    const auto r = ::read(fd, buf + nread, len - nread);
+    if (r == 0) break;
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      throw std::system_error {errno, std::system_category(), "failed to read"};
+    }
+    nread += static_cast<size_t>(r);
+  }
+  return nread;
+}
+
+// Same as `read_fully` but from `off` without moving the file offset.
+inline size_t pread_fully(const fd_t fd, uint8_t *buf, const size_t len, const size_t off) {
+  size_t nread = 0;
+  while (nread < len) {
+    const auto r = ::pread(fd, buf + nread, len - nread, static_cast<off_t>(off + nread));
+    if (r == 0) break;
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      throw std::system_error {errno, std::system_category(), "failed to read"};
+    }
+    nread += static_cast<size_t>(r);
+  }
+  return nread;
+}
+
+// Calls `fn(const dirent64&)` for each entry of directory `fd` from its
+// current offset, reading a batch at a time into `buf` via getdents64(2).
+// `buf` should be aligned for `dirent64`.
+template <typename FN>
+void for_each_dirent(const fd_t fd, const std::span<std::byte> buf, FN &&fn) {
+  for (;;) {
+    const auto n = ::getdents64(fd, buf.data(), buf.size());
+    if (n == 0) return;
+    if (n < 0) [[unlikely]] {
+      if (errno == EINTR) continue;
+      throw std::system_error {errno, std::system_category(), "getdents64"};
+    }
+    for (size_t off = 0; off < static_cast<size_t>(n);) {
+      const auto &d = *reinterpret_cast<const struct dirent64 *>(buf.data() + off);
+      off += d.d_reclen;
+      fn(d);
+    }
+  }
+}
+
+} // namespace detail
+
+template <typename R = std::vector<uint8_t>>
+R load_file(const path_t &p) {
+  const auto [fd, st] = detail::open_regular(p);
+
+  if constexpr (requires (R &r) {
+      requires sizeof(typename R::value_type) == 1;
+      r.data();
+      r.resize(size_t{});
+  }) {
+    R ret;
+    if (const auto siz = static_cast<size_t>(st.st_size);
+        siz && static_cast<size_t>(st.st_blocks) * 512 < siz) {
+      // Sparse: holes are left to the zeros of resize()
+      ret.resize(siz);
+      const auto p = reinterpret_cast<uint8_t *>(ret.data());
+      size_t end = 0;
+      for (const auto &[off, len] : data_extents(fd, siz)) {
+        end = off + detail::pread_fully(fd, p + off, len, off);
+        if (end < off + len) break;     // truncated meanwhile
+      }
+      if (end < siz && ::lseek(fd, 0, SEEK_END) < static_cast<off_t>(siz)) ret.resize(end);
+    } else if (siz) [[likely]] {
+      ret.resize(siz);
+      ret.resize(detail::read_fully(fd,
+            reinterpret_cast<uint8_t *>(ret.data()), siz));
+    } else {
+      // Files on pseudo filesystems (e.g. /proc) report zero size.
+      constexpr size_t chunk_siz = 4096;
+      for (size_t len = 0;; ) {
+        ret.resize(len + chunk_siz);
+        const auto r = detail::read_fully(fd,
+            reinterpret_cast<uint8_t *>(ret.data()) + len, chunk_siz);
+        len += r;
+        if (r < chunk_siz) {
+          ret.resize(len);
+          break;
+        }
+      }
+    }
+    return ret;
+  } else {
+    const auto buf = load_file<std::vector<uint8_t>>(p);
+    return {buf.begin(), buf.end()};
+  }
 }
 
+struct map_advice {
+  bool populate   = false;  // MAP_POPULATE: prefault the page tables
+  bool sequential = false;  // MADV_SEQUENTIAL: aggressive read-ahead
+  bool willneed   = false;  // MADV_WILLNEED: start read-ahead right away
+  bool hugepage   = false;  // MADV_HUGEPAGE: best effort
+};
+
+/// Read-only memory mapping of a whole regular file.
+class mapped_file {
+ public:
+  using advice = map_advice;
+
+  explicit mapped_file(const path_t &p, const advice adv = {}) :
+    mapped_file(detail::open_regular(p), adv)
+  {}
+
+  explicit mapped_file(unique_fd fd, const advice adv = {}) :
+    mapped_file(stat_regular(std::move(fd)), adv)
+  {}
+
+  mapped_file(mapped_file &&rhs) noexcept :
+    fd_(std::move(rhs.fd_)),
+    data_(std::exchange(rhs.data_, nullptr)),
+    size_(std::exchange(rhs.size_, 0))
+  {}
+
+  ~mapped_file() noexcept {
+    if (data_) ::munmap(const_cast<uint8_t *>(data_), size_);
+  }
+
+  mapped_file() = delete;
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+  mapped_file& operator=(mapped_file&&) = delete;
+
+  inline fd_t fd() const { return fd_; }
+  inline const uint8_t *data() const { return data_; }
+  inline size_t size() const { return size_; }
+  inline bool empty() const { return !size_; }
+  inline const uint8_t *begin() const { return data_; }
+  inline const uint8_t *end() const { return data_ + size_; }
+
+  inline std::span<const uint8_t> span() const { return {data_, size_}; }
+  inline operator std::span<const uint8_t>() const { return span(); }
+
+  /// Parts of the mapping backed by data, so that holes reading as zeros
+  /// can be skipped.
+  std::vector<std::span<const uint8_t>> data_extents() const {
+    std::vector<std::span<const uint8_t>> ret;
+    for (const auto &[off, len] : filesystem::data_extents(fd_, size_))
+      ret.emplace_back(data_ + off, len);
+    return ret;
+  }
+
+ private:
+  static std::pair<unique_fd, stat_t> stat_regular(unique_fd fd) {
+    std::pair<unique_fd, stat_t> ret {std::move(fd), stat_t {}};
+    if (::fstat(ret.first, &ret.second) == -1) [[unlikely]]
+      throw std::system_error {errno, std::system_category(),
+        "mapped_file: failed to stat"};
+    if (!S_ISREG(ret.second.st_mode)) [[unlikely]]
+      throw std::invalid_argument {"mapped_file: not a regular file"};
+    return ret;
+  }
+
+  mapped_file(std::pair<unique_fd, stat_t> &&fd_st, const advice adv) :
+    fd_(std::move(fd_st.first)),
+    data_(nullptr),
+    size_(static_cast<size_t>(fd_st.second.st_size))
+  {
+    if (!size_) return;  // mmap(2) rejects zero length
+
+    const auto flags = MAP_PRIVATE | (adv.populate ? MAP_POPULATE : 0);
+    const auto p = ::mmap(nullptr, size_, PROT_READ, flags, fd_, 0);
+    if (p == MAP_FAILED) [[unlikely]]
+      throw std::system_error {errno, std::system_category(),
+        "mapped_file: failed to mmap"};
+    data_ = static_cast<const uint8_t *>(p);
+
+    // Advices are hints; failing to apply them is not an error.
+    if (adv.sequential) ::madvise(p, size_, MADV_SEQUENTIAL);
+    if (adv.willneed) ::madvise(p, size_, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+    if (adv.hugepage) ::madvise(p, size_, MADV_HUGEPAGE);
+#endif
+  }
+
+ private:
+  unique_fd fd_;
+  const uint8_t *data_;
+  size_t size_;
+};
+
+/// Reads directories with getdents64(2) through a buffer kept across calls,
+/// so enumerating entries allocates nothing. Names are handed over as
+/// NUL terminated `string_view`s into the buffer along with `d_type`;
+/// `DT_UNKNOWN` is resolved with fstatat(2). "." and ".." are skipped.
+class dir_reader {
+ public:
+  explicit dir_reader(const size_t buf_siz = 256 * 1024) :
+    buf_(std::make_unique_for_overwrite<std::byte[]>(buf_siz)), buf_siz_(buf_siz)
+  {}
+
+  /// Calls `fn(std::string_view name, unsigned char d_type)` for each entry
+  /// of `dirfd` from its current offset. `dir` names `dirfd` in errors.
+  template <typename FN>
+  void for_each(const fd_t dirfd, FN &&fn, const std::string_view dir = {}) {
+    detail::for_each_dirent(dirfd, {buf_.get(), buf_siz_}, [&] (const struct dirent64 &d) {
+        const std::string_view name {d.d_name};
+        if (name == "." || name == "..") return;
+        auto type = d.d_type;
+        if (type == DT_UNKNOWN) {
+          stat_t st;
+          if (::fstatat(dirfd, d.d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) [[unlikely]]
+            throw std::system_error {errno, std::system_category(), "failed to stat "
+              + (dir.empty() ? std::string {name} : std::string {dir} + '/' + d.d_name)};
+          type = IFTODT(st.st_mode);
+        }
+        fn(name, type);
+      });
+  }
+
+  size_t count(const fd_t dirfd) {
+    size_t n = 0;
+    detail::for_each_dirent(dirfd, {buf_.get(), buf_siz_}, [&n] (const struct dirent64 &d) {
+        const std::string_view name {d.d_name};
+        n += name != "." && name != "..";
+      });
+    return n;
+  }
+
+ private:
+  // new[] is aligned enough for dirent64; left uninitialized as the kernel
+  // fills it
+  std::unique_ptr<std::byte[]> buf_;
+  size_t buf_siz_;
+};
+
 inline size_t dir_siz(const path_t dir) {
   if (!is_directory(dir))
     [[unlikely]] throw std::invalid_argument {"dir_siz: no directory " + dir.string()};
-  return std::distance(directory_iterator{dir}, directory_iterator{});
+  const auto fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1) [[unlikely]] throw std::system_error {
+    errno, std::system_category(), "dir_siz: failed to open " + dir.string()};
+  static thread_local dir_reader reader;
+  return reader.count(unique_fd {fd});
 }
 
+/// Sorted names of a directory, scanned once and then kept up to date from
+/// inotify(7) events on `poll()` instead of being listed again. An event
+/// queue overflow makes it rescan the directory. `on_change` is called for
+/// each name added to or removed from the index.
+class DirectoryIndex {
+ public:
+  enum class change { added, removed };
+  using callback = std::function<void(change, std::string_view name)>;
+
+  explicit DirectoryIndex(const path_t &dir, callback on_change = {}) :
+    dir_(dir), on_change_(std::move(on_change)),
+    ifd_(watch(dir)),     // before the scan so that no change slips in between
+    names_(scan(dir))
+  {}
+
+  DirectoryIndex(const DirectoryIndex&) = delete;
+  DirectoryIndex& operator=(const DirectoryIndex&) = delete;
+
+  inline const path_t &path() const { return dir_; }
+  inline size_t size() const { return names_.size(); }
+  inline bool empty() const { return names_.empty(); }
+  inline bool contains(const std::string_view name) const { return names_.contains(name); }
+  inline const std::set<std::string, std::less<>> &names() const { return names_; }
+  /// false once the directory itself is gone
+  inline bool watching() const { return watching_; }
+
+  /// inotify descriptor to wait on along with others; readable when
+  /// `poll()` has events to apply
+  inline fd_t fd() const { return ifd_; }
+
+  /// Waits up to `timeout` (forever if negative) for events and applies all
+  /// of them queued by then. Returns the number of changes to the index.
+  size_t poll(const std::chrono::nanoseconds timeout = std::chrono::nanoseconds::zero()) {
+    if (!watching_) return 0;
+
+    struct pollfd pfd {ifd_, POLLIN, 0};
+    const auto ms = timeout < timeout.zero() ? -1 : static_cast<int>(
+        std::min<std::chrono::milliseconds::rep>(INT_MAX,
+          std::chrono::ceil<std::chrono::milliseconds>(timeout).count()));
+    for (;;) {
+      if (const auto n = ::poll(&pfd, 1, ms); n >= 0) break;
+      if (errno != EINTR) [[unlikely]]
+        throw std::system_error {errno, std::system_category(), "poll"};
+    }
+    if (!(pfd.revents & POLLIN)) return 0;
+
+    size_t nchanges = 0;
+    for (;;) {
+      const auto n = ::read(ifd_, buf_.data(), buf_.size());
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN) break;
+        throw std::system_error {errno, std::system_category(), "failed to read inotify events"};
+      }
+      for (auto p = buf_.data(); p < buf_.data() + n;) {
+        const auto &ev = *reinterpret_cast<const struct inotify_event *>(p);
+        nchanges += apply(ev);
+        p += sizeof(struct inotify_event) + ev.len;
+      }
+    }
+    return nchanges;
+  }
+
+ private:
+  static unique_fd watch(const path_t &dir) {
+    const auto fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd == -1) [[unlikely]]
+      throw std::system_error {errno, std::system_category(), "inotify_init1"};
+    unique_fd ifd {fd};
+    constexpr uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+      | IN_DELETE_SELF | IN_ONLYDIR;
+    if (::inotify_add_watch(ifd, dir.c_str(), mask) == -1) [[unlikely]]
+      throw std::system_error {errno, std::system_category(), "failed to watch " + dir.string()};
+    return ifd;
+  }
+
+  // Not kept open between scans, which would hold off IN_DELETE_SELF.
+  static std::set<std::string, std::less<>> scan(const path_t &dir) {
+    std::set<std::string, std::less<>> names;
+    const auto fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) [[unlikely]]
+      throw std::system_error {errno, std::system_category(), "failed to open " + dir.string()};
+    dir_reader {64 * 1024}.for_each(unique_fd {fd}, [&names] (const std::string_view name, unsigned char) {
+        names.emplace(name);
+      });
+    return names;
+  }
+
+  size_t apply(const struct inotify_event &ev) {
+    if (ev.mask & IN_Q_OVERFLOW) return rescan();
+    if (ev.mask & (IN_DELETE_SELF | IN_IGNORED)) {
+      watching_ = false;
+      return 0;
+    }
+    if (!ev.len) return 0;
+
+    const std::string_view name {ev.name};
+    if (ev.mask & (IN_CREATE | IN_MOVED_TO)) {
+      if (!names_.emplace(name).second) return 0;
+      notify(change::added, name);
+    } else {
+      const auto it = names_.find(name);
+      if (it == names_.end()) return 0;
+      names_.erase(it);
+      notify(change::removed, name);
+    }
+    return 1;
+  }
+
+  // Lists the directory again and reports what differs from the index.
+  size_t rescan() {
+    auto names = scan(dir_);
+    std::swap(names_, names);
+
+    size_t nchanges = 0;
+    auto prev = names.cbegin();
+    auto cur = names_.cbegin();
+    while (prev != names.cend() || cur != names_.cend()) {
+      if (cur == names_.cend() || (prev != names.cend() && *prev < *cur)) {
+        notify(change::removed, *prev++);
+      } else if (prev == names.cend() || *cur < *prev) {
+        notify(change::added, *cur++);
+      } else {
+        ++prev, ++cur;
+        continue;
+      }
+      ++nchanges;
+    }
+    return nchanges;
+  }
+
+  inline void notify(const change c, const std::string_view name) const {
+    if (on_change_) on_change_(c, name);
+  }
+
+  path_t dir_;
+  callback on_change_;
+  unique_fd ifd_;
+  std::set<std::string, std::less<>> names_;
+  bool watching_ {true};
+  alignas(struct inotify_event) std::array<char, 16 * 1024> buf_;
+};
+
 template <int mode>
 inline bool access(const path_t &p) {
   return ::access(p.c_str(), mode) == 0;
@@ -143,6 +597,165 @@ class FileTrait
 template <typename T>
 concept FileT = std::is_base_of_v<FileTrait, T>;
 
+namespace detail {
+
+inline bool wait_writable(const fd_t fd) {
+  struct pollfd pfd { .fd = fd, .events = POLLOUT, .revents = 0 };
+  int r;
+  do {
+    r = ::poll(&pfd, 1, -1);
+  } while (r == -1 && errno == EINTR);
+  return r == 1 && !(pfd.revents & (POLLERR | POLLNVAL));
+}
+
+// Writes all of `iov`, retrying on EINTR, short writes and EAGAIN. `iov` is
+// consumed in place. Returns false with errno set on failure.
+inline bool write_all(const fd_t fd, struct iovec *iov, size_t iovcnt) {
+  while (iovcnt && !iov->iov_len) ++iov, --iovcnt;
+  while (iovcnt) {
+    auto r = ::writev(fd, iov, static_cast<int>(std::min<size_t>(iovcnt, IOV_MAX)));
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable(fd)) continue;
+      return false;
+    }
+
+    for (; iovcnt && static_cast<size_t>(r) >= iov->iov_len; ++iov, --iovcnt)
+      r -= static_cast<ssize_t>(iov->iov_len);
+    if (iovcnt) {
+      iov->iov_base = static_cast<uint8_t *>(iov->iov_base) + r;
+      iov->iov_len -= static_cast<size_t>(r);
+    }
+  }
+  return true;
+}
+
+/// Minimal io_uring wrapper over the raw syscalls; just enough to pipeline
+/// writes and fsyncs for `BufferedFileWriter`.
+class io_uring {
+ public:
+  // nullptr if the kernel doesn't support io_uring or it's disabled.
+  static std::unique_ptr<io_uring> create(const unsigned entries) {
+    struct io_uring_params params {};
+    const auto fd = static_cast<fd_t>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd == -1) return nullptr;
+    // Writes at the current file position (offset -1) need RW_CUR_POS.
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+      ::close(fd);
+      return nullptr;
+    }
+    return std::unique_ptr<io_uring>(new io_uring {unique_fd {fd}, params});
+  }
+
+  ~io_uring() noexcept {
+    if (sqes_ != MAP_FAILED) ::munmap(sqes_, sqes_siz_);
+    if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) ::munmap(cq_ptr_, cq_siz_);
+    if (sq_ptr_ != MAP_FAILED) ::munmap(sq_ptr_, sq_siz_);
+  }
+
+  io_uring(const io_uring&) = delete;
+  io_uring& operator=(const io_uring&) = delete;
+
+  // Queues an SQE; `submit` hands it to the kernel. Returns nullptr if full.
+  // Without SQPOLL the kernel reads SQEs only in io_uring_enter(2), so the
+  // tail can be published before the caller fills the entry in.
+  struct io_uring_sqe *get_sqe() {
+    const auto tail = *sq_tail_;
+    if (tail - std::atomic_ref {*sq_head_}.load(std::memory_order_acquire) >= sq_entries_)
+      return nullptr;
+    const auto idx = tail & *sq_mask_;
+    sq_array_[idx] = idx;
+    ++pending_;
+    auto sqe = &sqes_[idx];
+    *sqe = {};
+    std::atomic_ref {*sq_tail_}.store(tail + 1, std::memory_order_release);
+    return sqe;
+  }
+
+  // Submits queued SQEs and waits for at least `min_complete` CQEs.
+  void submit(const unsigned min_complete = 0) {
+    const auto flags = min_complete ? IORING_ENTER_GETEVENTS : 0u;
+    while (pending_ || min_complete) {
+      const auto r = ::syscall(__NR_io_uring_enter, static_cast<fd_t>(fd_),
+          pending_, min_complete, flags, nullptr, 0);
+      if (r < 0) {
+        if (errno == EINTR) continue;
+        throw std::system_error {errno, std::system_category(), "io_uring_enter"};
+      }
+      pending_ -= static_cast<unsigned>(r);
+      if (!pending_) break;
+    }
+  }
+
+  // Pops a completion if available.
+  bool pop_cqe(struct io_uring_cqe &cqe) {
+    const auto head = *cq_head_;
+    if (head == std::atomic_ref {*cq_tail_}.load(std::memory_order_acquire))
+      return false;
+    cqe = cqes_[head & *cq_mask_];
+    std::atomic_ref {*cq_head_}.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Blocks until a completion is available and pops it.
+  struct io_uring_cqe wait_cqe() {
+    struct io_uring_cqe cqe;
+    while (!pop_cqe(cqe)) {
+      const auto r = ::syscall(__NR_io_uring_enter, static_cast<fd_t>(fd_),
+          0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (r < 0 && errno != EINTR)
+        throw std::system_error {errno, std::system_category(), "io_uring_enter"};
+    }
+    return cqe;
+  }
+
+ private:
+  io_uring(unique_fd fd, const struct io_uring_params &p) : fd_(std::move(fd)) {
+    sq_siz_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_siz_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    const bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) sq_siz_ = cq_siz_ = std::max(sq_siz_, cq_siz_);
+
+    sq_ptr_ = ::mmap(nullptr, sq_siz_, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    cq_ptr_ = single_mmap ? sq_ptr_ : ::mmap(nullptr, cq_siz_,
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    sqes_siz_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    const auto sqes = ::mmap(nullptr, sqes_siz_, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    sqes_ = static_cast<struct io_uring_sqe *>(sqes);
+    if (sq_ptr_ == MAP_FAILED || cq_ptr_ == MAP_FAILED || sqes == MAP_FAILED)
+      [[unlikely]] throw std::system_error {errno, std::system_category(),
+        "failed to map io_uring"};
+
+    const auto sq = static_cast<uint8_t *>(sq_ptr_);
+    sq_head_  = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+    sq_tail_  = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    sq_mask_  = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    sq_entries_ = p.sq_entries;
+
+    const auto cq = static_cast<uint8_t *>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+  }
+
+ private:
+  unique_fd fd_;
+  void *sq_ptr_ {MAP_FAILED}, *cq_ptr_ {MAP_FAILED};
+  struct io_uring_sqe *sqes_ {static_cast<struct io_uring_sqe *>(MAP_FAILED)};
+  size_t sq_siz_ {}, cq_siz_ {}, sqes_siz_ {};
+  unsigned *sq_head_ {}, *sq_tail_ {}, *sq_mask_ {}, *sq_array_ {};
+  unsigned *cq_head_ {}, *cq_tail_ {}, *cq_mask_ {};
+  struct io_uring_cqe *cqes_ {};
+  unsigned sq_entries_ {};
+  unsigned pending_ {};
+};
+
+} // namespace detail
+
 template <FileT T>
 class FileWriter
 {
@@ -159,16 +772,74 @@ class FileWriter
   inline path_t path() const { return file_->path(); }
   T& file() const { return reinterpret_cast<T&>(*file_); }
 
+  /// Returns false with errno set on failure.
   bool write(const uint8_t *p, size_t l) {
-    while (l) {
-      const auto r = ::write(fd(), p, l);
-      if (r < 0) {
-        std::cerr << "failed to write to file: " << std::strerror(errno);
-        return false;
-      }
-      l -= static_cast<size_t>(r);
-    }
-    return true;
+    struct iovec iov { const_cast<uint8_t *>(p), l };
+    return detail::write_all(fd(), &iov, 1);
+  }
+
+  template <typename C> requires requires (const C &c) {
+    typename C::value_type;
+    requires sizeof(typename C::value_type) == 1;
+
+    c.data();
+    c.size();
+  }
+  inline bool write(const C &v) {
+    return write(reinterpret_cast<const uint8_t*>(v.data()), v.size());
+  }
+
+};
+
+struct buffer_options {
+  size_t buf_siz   = 64 * 1024;
+  // Flush through io_uring so that writes overlap with filling the next
+  // buffer. Falls back to writev(2) if the kernel lacks io_uring.
+  bool use_io_uring = false;
+};
+
+/// FileWriter coalescing records in a user-space buffer. It is not thread
+/// safe; give each thread its own writer. It isn't a `FileWriter` either,
+/// whose `write()` would go ahead of the buffered data.
+template <FileT T>
+class BufferedFileWriter : private FileWriter<T>
+{
+  using base_t = FileWriter<T>;
+
+ public:
+  using base_t::fd;
+  using base_t::path;
+  using base_t::file;
+
+  BufferedFileWriter() : BufferedFileWriter(buffer_options {}) {}
+
+  template <typename...ARGS>
+  explicit BufferedFileWriter(const buffer_options opt, ARGS&&...args) :
+    base_t(std::forward<ARGS>(args)...),
+    uring_(opt.use_io_uring ? detail::io_uring::create(4) : nullptr),
+    bufs_{std::vector<uint8_t>(opt.buf_siz),
+          std::vector<uint8_t>(uring_ ? opt.buf_siz : 0)}
+  {
+    if (!opt.buf_siz) [[unlikely]]
+      throw std::invalid_argument {"BufferedFileWriter: zero sized buffer"};
+  }
+
+  ~BufferedFileWriter() noexcept {
+    try {
+      flush();
+      drain();
+    } catch (...) {}
+  }
+
+  BufferedFileWriter(const BufferedFileWriter&) = delete;
+  BufferedFileWriter& operator=(const BufferedFileWriter&) = delete;
+
+  inline bool uses_io_uring() const { return static_cast<bool>(uring_); }
+  inline size_t buffered() const { return used_; }
+
+  bool write(const uint8_t *p, size_t l) {
+    struct iovec iov { const_cast<uint8_t *>(p), l };
+    return writev({&iov, 1});
   }
 
   template <typename C> requires requires (const C &c) {
@@ -182,6 +853,110 @@ class FileWriter
     return write(reinterpret_cast<const uint8_t*>(v.data()), v.size());
   }
 
+  /// Gathers `iov` into the buffer, or writes it out together with the
+  /// buffer in a single writev(2) when it doesn't fit.
+  bool writev(const std::span<const struct iovec> iov) {
+    if (error_) [[unlikely]] return fail();
+
+    size_t total = 0;
+    for (const auto &v : iov) total += v.iov_len;
+
+    if (total <= bufs_[cur_].size()) {
+      if (total > bufs_[cur_].size() - used_ && !flush()) return false;
+      auto &buf = bufs_[cur_];
+      for (const auto &v : iov) {
+        std::memcpy(buf.data() + used_, v.iov_base, v.iov_len);
+        used_ += v.iov_len;
+      }
+      return true;
+    }
+
+    // Larger than the whole buffer; bypass it along with the buffered data.
+    if (!drain()) return false;
+    std::vector<struct iovec> vec;
+    vec.reserve(iov.size() + 1);
+    if (used_) vec.push_back({bufs_[cur_].data(), std::exchange(used_, 0)});
+    vec.insert(vec.end(), iov.begin(), iov.end());
+    if (!detail::write_all(this->fd(), vec.data(), vec.size())) return fail(errno);
+    return true;
+  }
+
+  /// Hands buffered data over to the kernel. With io_uring it returns once
+  /// the write is submitted; the next flush waits for it.
+  bool flush() {
+    if (error_) [[unlikely]] return fail();
+    if (!used_) return true;
+
+    if (!uring_) {
+      struct iovec iov { bufs_[cur_].data(), std::exchange(used_, 0) };
+      return detail::write_all(this->fd(), &iov, 1) || fail(errno);
+    }
+
+    if (!drain()) return false;
+    auto sqe = next_sqe();
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = this->fd();
+    sqe->off = static_cast<uint64_t>(-1);
+    sqe->addr = reinterpret_cast<uint64_t>(bufs_[cur_].data());
+    sqe->len = static_cast<uint32_t>(used_);
+    uring_->submit();
+
+    inflight_ = {bufs_[cur_].data(), std::exchange(used_, 0)};
+    cur_ ^= 1;
+    return true;
+  }
+
+  /// Durability barrier: flushes and waits until data hits the storage via
+  /// fdatasync(2).
+  bool sync() {
+    if (!flush() || !drain()) return false;
+
+    if (!uring_) return ::fdatasync(this->fd()) == 0 || fail(errno);
+
+    auto sqe = next_sqe();
+    sqe->opcode = IORING_OP_FSYNC;
+    sqe->fd = this->fd();
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    uring_->submit();
+    if (const auto cqe = uring_->wait_cqe(); cqe.res < 0) return fail(-cqe.res);
+    return true;
+  }
+
+ private:
+  // Waits for the write in flight, completing a short one synchronously.
+  bool drain() {
+    if (!inflight_.iov_len) return !error_ || fail();
+
+    const auto cqe = uring_->wait_cqe();
+    auto iov = std::exchange(inflight_, {});
+    if (cqe.res < 0) return fail(-cqe.res);
+
+    const auto n = static_cast<size_t>(cqe.res);
+    iov.iov_base = static_cast<uint8_t *>(iov.iov_base) + n;
+    iov.iov_len -= n;
+    return detail::write_all(this->fd(), &iov, 1) || fail(errno);
+  }
+
+  // At most one write is in flight, so the ring is never full once
+  // submitted SQEs are handed over to the kernel.
+  struct io_uring_sqe *next_sqe() {
+    if (const auto sqe = uring_->get_sqe(); sqe) [[likely]] return sqe;
+    uring_->submit();
+    const auto sqe = uring_->get_sqe();
+    if (!sqe) [[unlikely]] throw std::logic_error {"BufferedFileWriter: io_uring is full"};
+    return sqe;
+  }
+
+  inline bool fail(const int err) { errno = error_ = err; return false; }
+  inline bool fail() { errno = error_; return false; }
+
+ private:
+  std::unique_ptr<detail::io_uring> uring_;
+  std::array<std::vector<uint8_t>, 2> bufs_;
+  size_t cur_ {0};
+  size_t used_ {0};
+  struct iovec inflight_ {};
+  int error_ {0};
 };
 
 class AnonymousFile : public FileTrait
@@ -233,6 +1008,145 @@ class TempFile : public FileTrait
   fd_t fd_ {-1};
 };
 
+/// Links `fd`, an O_TMPFILE opened without O_EXCL, into the filesystem as
+/// `p`, replacing what's there atomically. `p` should be on the filesystem
+/// the file was created on.
+inline void publish(const fd_t fd, const path_t &p)
+{
+  const auto proc = "/proc/self/fd/" + std::to_string(fd);
+  if (::linkat(AT_FDCWD, proc.c_str(), AT_FDCWD, p.c_str(), AT_SYMLINK_FOLLOW) == 0) [[likely]]
+    return;
+  if (errno != EEXIST) [[unlikely]] throw std::system_error {
+    errno, std::system_category(), "failed to publish " + p.string()};
+
+  // linkat(2) doesn't replace, so link next to it and rename over.
+  for (unsigned i = 0;; ++i) {
+    auto tmp = p;
+    tmp += "." + std::to_string(::getpid()) + "." + std::to_string(fd) + "." + std::to_string(i);
+    if (::linkat(AT_FDCWD, proc.c_str(), AT_FDCWD, tmp.c_str(), AT_SYMLINK_FOLLOW) == -1) {
+      if (errno == EEXIST) continue;
+      throw std::system_error {errno, std::system_category(), "failed to publish " + p.string()};
+    }
+    if (::rename(tmp.c_str(), p.c_str()) == -1) [[unlikely]] {
+      const auto err = errno;
+      ::unlink(tmp.c_str());
+      throw std::system_error {err, std::system_category(), "failed to publish " + p.string()};
+    }
+    return;
+  }
+}
+
+struct tempfile_pool_options {
+  path_t dir {temp_directory_path()};
+  size_t capacity {16};
+  /// blocks reserved up front by fallocate(2), keeping the size 0
+  size_t prealloc_siz {0};
+};
+
+/// Anonymous files created ahead of time on a background thread, so that
+/// taking one costs a lock rather than a trip to the filesystem. Falls back
+/// to creating one on the spot when the pool has run dry.
+class TempFilePool {
+ public:
+  TempFilePool() : TempFilePool(tempfile_pool_options {}) {}
+  explicit TempFilePool(tempfile_pool_options opts) :
+    opts_(std::move(opts)), refill_([this] { run(); })
+  {}
+  ~TempFilePool() noexcept {
+    {
+      std::lock_guard lock {m_};
+      stop_ = true;
+    }
+    cv_.notify_all();
+    refill_.join();
+  }
+
+  TempFilePool(const TempFilePool&) = delete;
+  TempFilePool& operator=(const TempFilePool&) = delete;
+
+  unique_fd acquire() {
+    {
+      std::lock_guard lock {m_};
+      if (!fds_.empty()) {
+        auto fd = std::move(fds_.back());
+        fds_.pop_back();
+        cv_.notify_one();
+        return fd;
+      }
+    }
+    cv_.notify_one();
+    return create();
+  }
+
+  inline size_t available() const {
+    std::lock_guard lock {m_};
+    return fds_.size();
+  }
+
+ private:
+  unique_fd create() const {
+    const auto fd = ::open(opts_.dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd == -1) [[unlikely]] throw std::system_error {
+      errno, std::system_category(), "failed to create temporary file in " + opts_.dir.string()};
+    unique_fd ufd {fd};
+    // A filesystem without fallocate(2) still makes a usable file.
+    if (opts_.prealloc_siz) ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(opts_.prealloc_siz));
+    return ufd;
+  }
+
+  void run() {
+    std::unique_lock lock {m_};
+    for (;;) {
+      cv_.wait(lock, [this] { return stop_ || fds_.size() < opts_.capacity; });
+      if (stop_) return;
+
+      lock.unlock();
+      std::optional<unique_fd> fd;
+      try {
+        fd.emplace(create());
+      } catch (const std::system_error &) {
+        // Leave it to acquire(), which reports the error to its caller.
+      }
+      lock.lock();
+
+      if (!fd) {
+        cv_.wait_for(lock, std::chrono::seconds {1}, [this] { return stop_; });
+        continue;
+      }
+      fds_.push_back(std::move(*fd));
+    }
+  }
+
+  const tempfile_pool_options opts_;
+  mutable std::mutex m_;
+  std::condition_variable cv_;
+  std::vector<unique_fd> fds_;
+  bool stop_ {false};
+  std::thread refill_;
+};
+
+/// Anonymous file taken from `TempFilePool` which gets a name on `publish()`.
+class PooledFile : public FileTrait
+{
+ public:
+  explicit PooledFile(TempFilePool &pool) : fd_(pool.acquire()) {}
+
+  const path_t &path() const final {
+    if (path_.empty()) [[unlikely]] throw std::logic_error {"PooledFile is not published yet"};
+    return path_;
+  }
+  fd_t fd() const final { return fd_; }
+
+  void publish(const path_t &p) {
+    filesystem::publish(fd_, p);
+    path_ = p;
+  }
+
+ private:
+  unique_fd fd_;
+  path_t path_;
+};
+
 class TempDir : public FileTrait {
  public:
   TempDir() = delete;
@@ -306,17 +1220,401 @@ inline void copy_attrs(const path_t &from, const path_t &to, const directory_ent
   last_write_time(dst, last_write_time(from));
 }
 
+/// Counters of `copy_tree()` which may be read while it's running.
+struct copy_progress {
+  std::atomic<uint64_t> files {0};
+  std::atomic<uint64_t> dirs {0};
+  std::atomic<uint64_t> symlinks {0};
+  std::atomic<uint64_t> bytes {0};
+  std::chrono::steady_clock::time_point start {std::chrono::steady_clock::now()};
+
+  /// bytes per second since `start`
+  inline double throughput() const {
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() > 0 ? static_cast<double>(bytes.load()) / elapsed.count() : 0;
+  }
+};
+
+namespace detail {
+
+// Copies `len` bytes at `off` of `in` to the same offset of `out` in kernel
+// by copy_file_range(2), or sendfile(2) across filesystems it refuses and
+// pread/pwrite as the last resort. Methods found unsupported are cleared
+// in `cfr` and `sf` for the next call.
+inline size_t copy_range(const fd_t in, const fd_t out, const size_t off, const size_t len,
+    bool &cfr, bool &sf)
+{
+  size_t done = 0;
+  while (done < len) {
+    auto ioff = static_cast<off_t>(off + done), ooff = ioff;
+    ssize_t n = -1;
+    if (cfr) {
+      n = ::copy_file_range(in, &ioff, out, &ooff, len - done, 0);
+      if (n == -1 && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP
+            || errno == EINVAL)) {
+        cfr = false;
+        continue;
+      }
+    } else if (sf) {
+      if (::lseek(out, ooff, SEEK_SET) == -1) [[unlikely]]
+        throw std::system_error {errno, std::system_category(), "failed to seek"};
+      n = ::sendfile(out, in, &ioff, len - done);
+      if (n == -1 && (errno == ENOSYS || errno == EINVAL)) {
+        sf = false;
+        continue;
+      }
+    } else {
+      std::array<uint8_t, 64 * 1024> buf;
+      n = ::pread(in, buf.data(), std::min(buf.size(), len - done), ioff);
+      for (ssize_t w = 0; n > 0 && w < n;) {
+        const auto r = ::pwrite(out, buf.data() + w, static_cast<size_t>(n - w), ooff + w);
+        if (r == -1 && errno == EINTR) continue;
+        if (r == -1) {
+          n = -1;
+          break;
+        }
+        w += r;
+      }
+    }
+    if (n == 0) break;    // shrunk while copying
+    if (n < 0) [[unlikely]] {
+      if (errno == EINTR) continue;
+      throw std::system_error {errno, std::system_category(), "failed to copy"};
+    }
+    done += static_cast<size_t>(n);
+  }
+  return done;
+}
+
+// Copies the body of `in` to `out`, an empty file: a reflink if the
+// filesystem supports it, otherwise data extents one by one so that holes
+// stay holes. Returns the number of bytes of data copied.
+inline size_t copy_body(const fd_t in, const fd_t out, const size_t siz) {
+  if (!siz || ::ioctl(out, FICLONE, in) == 0) return siz;
+
+  bool cfr = true, sf = true;
+  size_t ndata = 0, end = 0;
+  for (const auto &[off, len] : data_extents(in, siz)) {
+    const auto n = copy_range(in, out, off, len, cfr, sf);
+    ndata += n;
+    end = off + n;
+    if (n < len) return ndata;
+  }
+  // a trailing hole
+  if (end < siz && ::ftruncate(out, static_cast<off_t>(siz)) == -1) [[unlikely]]
+    throw std::system_error {errno, std::system_category(), "failed to truncate"};
+  return ndata;
+}
+
+// Directories relative to a root handed over between `nthreads` workers
+// of `run()`. Each takes from the back of its own queue and steals from the
+// front of the others. `visit(i, rel)` runs on worker `i` and may `push(i, ...)`
+// subdirectories; the first exception stops the rest and is rethrown.
+class dir_queue {
+ public:
+  explicit dir_queue(const unsigned nthreads) : workers_(std::max(1u, nthreads)) {}
+
+  inline size_t size() const { return workers_.size(); }
+
+  void push(const size_t i, std::string rel) {
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    {
+      std::lock_guard lock {workers_[i].m};
+      workers_[i].q.push_back(std::move(rel));
+    }
+    queued_.fetch_add(1, std::memory_order_release);
+    wake(false);
+  }
+
+  template <typename VISIT>
+  void run(std::string root, VISIT &&visit) {
+    push(0, std::move(root));
+    std::vector<std::thread> threads;
+    threads.reserve(workers_.size() - 1);
+    for (size_t i = 1; i < workers_.size(); ++i) threads.emplace_back([&, i] { work(i, visit); });
+    work(0, visit);
+    for (auto &t : threads) t.join();
+    if (error_) std::rethrow_exception(error_);
+  }
+
+ private:
+  struct worker {
+    std::mutex m;
+    std::deque<std::string> q;
+  };
+
+  std::optional<std::string> take(const size_t i) {
+    for (size_t n = 0; n < workers_.size(); ++n) {
+      auto &w = workers_[(i + n) % workers_.size()];
+      std::lock_guard lock {w.m};
+      if (w.q.empty()) continue;
+      std::string rel;
+      if (n) {
+        rel = std::move(w.q.front());
+        w.q.pop_front();
+      } else {
+        rel = std::move(w.q.back());
+        w.q.pop_back();
+      }
+      queued_.fetch_sub(1, std::memory_order_relaxed);
+      return rel;
+    }
+    return std::nullopt;
+  }
+
+  template <typename VISIT>
+  void work(const size_t i, VISIT &visit) {
+    while (pending_.load(std::memory_order_acquire)) {
+      auto rel = take(i);
+      if (!rel) {
+        std::unique_lock lock {idle_m_};
+        idle_cv_.wait(lock, [this] {
+            return queued_.load(std::memory_order_acquire) || !pending_.load(std::memory_order_acquire);
+          });
+        continue;
+      }
+      try {
+        if (!error_flag_.load(std::memory_order_relaxed)) visit(i, *rel);
+      } catch (...) {
+        if (!error_flag_.exchange(true)) error_ = std::current_exception();
+      }
+      if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) wake(true);
+    }
+  }
+
+  // Passing through `idle_m_` orders the change ahead of a waiter checking
+  // it, so that the notification isn't lost in between.
+  void wake(const bool all) {
+    { std::lock_guard lock {idle_m_}; }
+    if (all) idle_cv_.notify_all();
+    else idle_cv_.notify_one();
+  }
+
+  std::vector<worker> workers_;
+  std::atomic<size_t> pending_ {0};   // directories queued or being visited
+  std::atomic<size_t> queued_ {0};
+  std::mutex idle_m_;
+  std::condition_variable idle_cv_;
+  std::atomic<bool> error_flag_ {false};
+  std::exception_ptr error_;
+};
+
+inline const char *relative_name(const std::string &rel) { return rel.empty() ? "." : rel.c_str(); }
+
+class tree_copier {
+ public:
+  tree_copier(const fd_t src, const fd_t dst, copy_progress &progress, const unsigned nthreads) :
+    src_(src), dst_(dst), progress_(progress), queue_(nthreads),
+    readers_(queue_.size()), dirs_(queue_.size())
+  {}
+
+  void run() {
+    queue_.run({}, [this] (const size_t i, const std::string &rel) { copy_dir(i, rel); });
+
+    // Entries created in a directory touch its times, so it's done after all.
+    for (const auto &dirs : dirs_) {
+      for (const auto &[rel, st] : dirs) {
+        const struct timespec times[2] {st.st_atim, st.st_mtim};
+        if (::utimensat(dst_, relative_name(rel), times, 0) == -1
+            || ::fchmodat(dst_, relative_name(rel), st.st_mode & 07777, 0) == -1) [[unlikely]]
+        {
+          throw std::system_error {errno, std::system_category(),
+            "failed to set attributes of " + rel};
+        }
+      }
+    }
+  }
+
+ private:
+  static unique_fd open_dir(const fd_t at, const char *name) {
+    const auto fd = ::openat(at, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd == -1) [[unlikely]] throw std::system_error {
+      errno, std::system_category(), "failed to open " + std::string{name}};
+    return {fd};
+  }
+
+  void copy_dir(const size_t i, const std::string &rel) {
+    const auto name = relative_name(rel);
+    const auto in = open_dir(src_, name);
+    stat_t st;
+    if (::fstat(in, &st) == -1) [[unlikely]]
+      throw std::system_error {errno, std::system_category(), "failed to stat " + rel};
+    if (!rel.empty() && ::mkdirat(dst_, name, S_IRWXU) == -1) [[unlikely]]
+      throw std::system_error {errno, std::system_category(), "failed to create " + rel};
+    const auto out = open_dir(dst_, name);
+
+    dirs_[i].emplace_back(rel, st);
+    progress_.dirs.fetch_add(1, std::memory_order_relaxed);
+
+    readers_[i].for_each(in, [&] (const std::string_view entry, const unsigned char type) {
+        const auto ename = entry.data();   // NUL terminated
+        switch (type) {
+          case DT_DIR:
+            queue_.push(i, rel.empty() ? std::string {entry} : rel + '/' + ename);
+            break;
+          case DT_REG:
+            copy_file(in, out, ename);
+            break;
+          case DT_LNK:
+            copy_symlink(in, out, ename);
+            break;
+          default:
+            throw std::system_error {std::make_error_code(std::errc::not_supported),
+              "can't copy special file " + rel + '/' + ename};
+        }
+      }, rel);
+  }
+
+  void copy_file(const fd_t in_dir, const fd_t out_dir, const char *name) {
+    const auto ifd = ::openat(in_dir, name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (ifd == -1) [[unlikely]]
+      throw std::system_error {errno, std::system_category(), "failed to open " + std::string{name}};
+    const unique_fd in {ifd};
+    stat_t st;
+    if (::fstat(in, &st) == -1) [[unlikely]]
+      throw std::system_error {errno, std::system_category(), "failed to stat " + std::string{name}};
+
+    const auto ofd = ::openat(out_dir, name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (ofd == -1) [[unlikely]]
+      throw std::system_error {errno, std::system_category(), "failed to create " + std::string{name}};
+    const unique_fd out {ofd};
+
+    const auto n = copy_body(in, out, static_cast<size_t>(st.st_size));
+    const struct timespec times[2] {st.st_atim, st.st_mtim};
+    if (::fchmod(out, st.st_mode & 07777) == -1 || ::futimens(out, times) == -1) [[unlikely]]
+      throw std::system_error {errno, std::system_category(),
+        "failed to set attributes of " + std::string{name}};
+
+    progress_.files.fetch_add(1, std::memory_order_relaxed);
+    progress_.bytes.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  void copy_symlink(const fd_t in_dir, const fd_t out_dir, const char *name) {
+    std::array<char, PATH_MAX> target;
+    const auto n = ::readlinkat(in_dir, name, target.data(), target.size() - 1);
+    if (n == -1) [[unlikely]]
+      throw std::system_error {errno, std::system_category(), "failed to read " + std::string{name}};
+    target[static_cast<size_t>(n)] = '\0';
+
+    stat_t st;
+    if (::fstatat(in_dir, name, &st, AT_SYMLINK_NOFOLLOW) == -1
+        || ::symlinkat(target.data(), out_dir, name) == -1) [[unlikely]]
+      throw std::system_error {errno, std::system_category(), "failed to copy " + std::string{name}};
+    const struct timespec times[2] {st.st_atim, st.st_mtim};
+    ::utimensat(out_dir, name, times, AT_SYMLINK_NOFOLLOW);
+
+    progress_.symlinks.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  const fd_t src_, dst_;
+  copy_progress &progress_;
+  dir_queue queue_;
+  std::vector<dir_reader> readers_;
+  std::vector<std::vector<std::pair<std::string, stat_t>>> dirs_;
+};
+
+} // namespace detail
+
+/// Copies the tree at `from` into `to` on `nthreads` threads, keeping
+/// modes, timestamps and symlinks. File bodies are reflinked where the
+/// filesystem allows and copied in kernel otherwise. `to` is created
+/// unless it is an existing directory; existing files in it are errors.
+/// A single file copied onto an existing directory lands in it under its
+/// own name. `progress` may be watched from another thread meanwhile.
+inline void copy_tree(const path_t &from, const path_t &to,
+    copy_progress *progress = nullptr, unsigned nthreads = 0)
+{
+  copy_progress local;
+  auto &prog = progress ? *progress : local;
+  if (!nthreads) nthreads = std::max(1u, std::thread::hardware_concurrency());
+
+  if (!is_directory(from)) {
+    const auto [in, st] = detail::open_regular(from);
+    const auto dst = is_directory(to) ? to / from.filename() : to;
+    const auto ofd = ::open(dst.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (ofd == -1) [[unlikely]]
+      throw std::system_error {errno, std::system_category(), "failed to create " + dst.string()};
+    const unique_fd out {ofd};
+    prog.bytes += detail::copy_body(in, out, static_cast<size_t>(st.st_size));
+    const struct timespec times[2] {st.st_atim, st.st_mtim};
+    if (::fchmod(out, st.st_mode & 07777) == -1 || ::futimens(out, times) == -1) [[unlikely]]
+      throw std::system_error {errno, std::system_category(),
+        "failed to set attributes of " + dst.string()};
+    ++prog.files;
+    return;
+  }
+
+  if (::mkdir(to.c_str(), S_IRWXU) == -1 && (errno != EEXIST || !is_directory(to))) [[unlikely]]
+    throw std::system_error {errno, std::system_category(), "failed to create " + to.string()};
+
+  const auto open_dir = [] (const path_t &p) {
+    const auto fd = ::open(p.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) [[unlikely]] throw std::system_error {
+      errno, std::system_category(), "failed to open " + p.string()};
+    return unique_fd {fd};
+  };
+  const auto src = open_dir(from);
+  const auto dst = open_dir(to);
+  detail::tree_copier {src, dst, prog, nthreads}.run();
+}
+
+/// Entry of a directory handed over by `walk()`. `dir` is relative to the
+/// root and `dirfd` is open on it for openat(2) and friends.
+struct walk_entry {
+  std::string_view dir;
+  std::string_view name;
+  unsigned char type;
+  fd_t dirfd;
+};
+
+/// Visits every entry under `root` on `nthreads` threads, calling
+/// `fn(const walk_entry&)` concurrently. Subdirectories are visited unless
+/// `fn` returns false for them. Each thread holds one directory open at a
+/// time and opens the next relative to `root`.
+template <typename FN>
+void walk(const path_t &root, FN &&fn, unsigned nthreads = 0)
+{
+  if (!nthreads) nthreads = std::max(1u, std::thread::hardware_concurrency());
+
+  const auto rfd = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (rfd == -1) [[unlikely]] throw std::system_error {
+    errno, std::system_category(), "walk: failed to open " + root.string()};
+  const unique_fd rootfd {rfd};
+
+  detail::dir_queue queue {nthreads};
+  std::vector<dir_reader> readers(queue.size());
+  queue.run({}, [&] (const size_t i, const std::string &rel) {
+      const auto fd = ::openat(rootfd, detail::relative_name(rel),
+          O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+      if (fd == -1) [[unlikely]] throw std::system_error {
+        errno, std::system_category(), "walk: failed to open " + rel};
+      const unique_fd dirfd {fd};
+
+      readers[i].for_each(dirfd, [&] (const std::string_view name, const unsigned char type) {
+          const walk_entry e {rel, name, type, dirfd};
+          bool descend = type == DT_DIR;
+          if constexpr (std::is_convertible_v<std::invoke_result_t<FN&, const walk_entry&>, bool>) {
+            descend = fn(e) && descend;
+          } else {
+            fn(e);
+          }
+          if (descend) queue.push(i, rel.empty() ? std::string {name} : rel + '/' + name.data());
+        });
+    });
+}
+
+/// `copy_tree()` reporting failures to stderr. Symlinks are copied as
+/// links, not followed, and every entry keeps its own timestamps.
 inline bool copy_all(const path_t &from, const path_t &to)
 {
   if (from == to) [[unlikely]] return false;
 
-  std::error_code ec;
-  copy(from, to, copy_options::recursive, ec);
-  if (!ec) [[likely]] copy_attrs(from, to, directory_entry {from});
-
-  if (ec) [[unlikely]]
+  try {
+    copy_tree(from, to);
+  } catch (const std::exception &e) {
     std::cerr << "failed to copy " << from << " to " << to
-      << ": " << ec.message();
+      << ": " << e.what();
+  }
 
   return true;
 }
@@ -1,46 +1,147 @@
 #pragma once
 #include <algorithm>
-#include <cctype>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <concepts>
 #include <cstddef>
-#include <iomanip>
-#include <ios>
-#include <iterator>
+#include <cstdint>
 #include <memory>
-#include <sstream>
-#include <tuple>
+#include <ostream>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <unistd.h>
 
 namespace gh4ck3r {
 
-template <typename Iter>
-auto hexdump(const Iter beg, const Iter end)
-{
-  std::ostringstream oss;
-  oss << std::hex;
+namespace detail::hexdump {
 
-  constexpr auto col_bytes = sizeof(*beg);
-  constexpr std::ptrdiff_t width = 0x10 / col_bytes;
+inline constexpr auto hex_tbl = [] {
+  constexpr char digits[] {"0123456789abcdef"};
+  std::array<char, 512> tbl {};
+  for (size_t i = 0; i < 256; ++i) {
+    tbl[2 * i] = digits[i >> 4];
+    tbl[2 * i + 1] = digits[i & 0xf];
+  }
+  return tbl;
+}();
+
+// Longest row is of byte columns: "0x" + 16 digits of address, 2 spaces,
+// 16 * "xx " and 16 characters with a leading space, then newline.
+inline constexpr size_t max_row = 2 + 2 * sizeof(uintptr_t) + 2 + 3 * 16 + 1 + 16 + 1;
+
+inline char *put_address(char *out, const uintptr_t addr) {
+  // same as `std::ostream << const void*`
+  if (!addr) {
+    *out++ = '0';
+    return out;
+  }
+  *out++ = '0';
+  *out++ = 'x';
+  const auto ndigits = (std::bit_width(addr) + 3) / 4;
+  for (auto i = ndigits; i--;) *out++ = "0123456789abcdef"[(addr >> (4 * i)) & 0xf];
+  return out;
+}
+
+// Formats rows of 16 bytes into a buffer on stack and hands them over to
+// `emit` as `std::string_view`s of many rows each.
+template <typename T, typename EMIT>
+void dump(const T * const data, const size_t len, EMIT &&emit) {
+  using U = std::make_unsigned_t<T>;
+  constexpr size_t col_bytes = sizeof(T);
+  constexpr size_t width = 0x10 / col_bytes;
   static_assert(width);
-  for (auto [cur, ncols] = std::tuple {beg, std::ptrdiff_t{}};
-      cur != end;
-      cur += ncols, oss << '\n')
-  {
-    ncols = std::min(width , end - cur);
-
-    oss << std::setfill('0')
-      << reinterpret_cast<const void*>(std::addressof(*beg) + (cur - beg))
-      << "  ";
-
-    transform(cur, cur + ncols, std::ostream_iterator<int> {oss, " "},
-        [&oss] (const auto &c) {
-          oss.width(2 * col_bytes);
-          return 0xff & c;
-        });
-    std::fill_n(std::ostream_iterator<char> {oss}, (1 + 2 * col_bytes) * (width - ncols), ' ');
-    transform(cur, cur + ncols, std::ostream_iterator<char> {oss << ' '},
-        [] (const auto &c) { return std::isprint(c) ? c : '.'; });
+
+  std::array<char, 64 * max_row> buf;
+  char *out = buf.data();
+  for (size_t cur = 0; cur < len; cur += width) {
+    if (static_cast<size_t>(buf.data() + buf.size() - out) < max_row) {
+      emit(std::string_view(buf.data(), static_cast<size_t>(out - buf.data())));
+      out = buf.data();
+    }
+    const auto ncols = std::min(width, len - cur);
+
+    out = put_address(out, reinterpret_cast<uintptr_t>(data + cur));
+    *out++ = ' ';
+    *out++ = ' ';
+    for (size_t i = 0; i < ncols; ++i) {
+      const auto v = static_cast<U>(data[cur + i]);
+      for (auto b = col_bytes; b--;) {
+        const auto byte = static_cast<uint8_t>(v >> (8 * b));
+        *out++ = hex_tbl[2 * byte];
+        *out++ = hex_tbl[2 * byte + 1];
+      }
+      *out++ = ' ';
+    }
+    out = std::fill_n(out, (1 + 2 * col_bytes) * (width - ncols), ' ');
+    *out++ = ' ';
+    for (size_t i = 0; i < ncols; ++i) {
+      const auto v = static_cast<U>(data[cur + i]);
+      *out++ = v >= 0x20 && v < 0x7f ? static_cast<char>(v) : '.';
+    }
+    *out++ = '\n';
+  }
+  if (out != buf.data()) {
+    emit(std::string_view(buf.data(), static_cast<size_t>(out - buf.data())));
+  }
+}
+
+} // namespace detail::hexdump
+
+/// Streams hexdump of `data` to `sink`, which is one of `std::ostream`, file
+/// descriptor or callable taking `std::string_view`. Throws `system_error`
+/// if writing to file descriptor fails.
+template <typename SINK, std::ranges::contiguous_range R>
+void hexdump_to(SINK &&sink, const R &data)
+{
+  using T = std::remove_cv_t<std::ranges::range_value_t<R>>;
+  const auto p = std::ranges::data(data);
+  const auto len = static_cast<size_t>(std::ranges::size(data));
+
+  using sink_t = std::remove_cvref_t<SINK>;
+  if constexpr (std::is_base_of_v<std::ostream, sink_t>) {
+    detail::hexdump::dump<T>(p, len, [&sink] (const std::string_view rows) {
+        sink.write(rows.data(), static_cast<std::streamsize>(rows.size()));
+      });
+  } else if constexpr (std::is_same_v<sink_t, int>) {
+    detail::hexdump::dump<T>(p, len, [fd = sink] (std::string_view rows) {
+        while (!rows.empty()) {
+          if (const auto n = ::write(fd, rows.data(), rows.size()); n >= 0) [[likely]] {
+            rows.remove_prefix(static_cast<size_t>(n));
+          } else if (errno != EINTR) {
+            throw std::system_error {errno, std::system_category(), "write"};
+          }
+        }
+      });
+  } else {
+    static_assert(std::invocable<SINK&, std::string_view>,
+        "sink should be std::ostream, file descriptor or callable");
+    detail::hexdump::dump<T>(p, len, sink);
   }
+}
+
+template <typename SINK>
+inline void hexdump_to(SINK &&sink, const void *ptr, const size_t len)
+{
+  hexdump_to(std::forward<SINK>(sink),
+      std::span {static_cast<const uint8_t *>(ptr), len});
+}
+
+template <typename Iter>
+auto hexdump(const Iter beg, const Iter end)
+{
+  std::string ret;
+  if (beg == end) return ret;
 
-  return oss.str();
+  const auto p = std::addressof(*beg);
+  detail::hexdump::dump<std::remove_cv_t<std::remove_pointer_t<decltype(p)>>>(
+      p, static_cast<size_t>(end - beg),
+      [&ret] (const std::string_view rows) { ret += rows; });
+  return ret;
 }
 
 template <typename T>
@@ -1,49 +1,109 @@
 #pragma once
+#include <atomic>
+#include <exception>
 #include <functional>
-#include <variant>
+#include <memory>
 #include <mutex>
+#include <new>
+#include <thread>
 #include <type_traits>
+#include <vector>
+#include "defer.hh"
 
 namespace gh4ck3r {
 
-template <typename GETTER,
-         typename = std::enable_if_t<std::is_invocable_v<GETTER>>>
+/// Holds either `GETTER` or the value it returned. Once the value is there
+/// reading it costs an acquire load of a flag. `SYNC = false` drops the
+/// synchronization for objects that never leave a thread.
+template <typename GETTER, bool SYNC = true>
+  requires std::is_invocable_v<GETTER>
 class LazyGetter {
   using T = std::invoke_result_t<GETTER>;
   static_assert(!std::is_const_v<T>);
   static_assert(!std::is_reference_v<T>);
   static_assert(!std::is_array_v<T>);
   static_assert(!std::is_void_v<T>);
+  // so that the getter can be dropped only once its value is in hand
+  static_assert(std::is_nothrow_move_constructible_v<T>);
 
   LazyGetter() = delete;
 
  public:
-  explicit LazyGetter(GETTER getter) : val_(getter) {}
+  explicit LazyGetter(GETTER getter) : getter_(std::move(getter)) {}
+  ~LazyGetter() {
+    if (ready()) val_.~T();
+    else getter_.~GETTER();
+  }
 
-  operator T&() const {
-    return std::visit([&] (auto &v) -> T& {
-        using V = std::remove_reference_t<std::remove_cv_t<decltype(v)>>;
-        if constexpr (std::is_same_v<V, GETTER>) {
-          std::call_once(flag_, [&] {val_ = v();});
-        }
-        return std::get<T>(val_);
-      }, val_);
+  LazyGetter(const LazyGetter&) = delete;
+  LazyGetter& operator=(const LazyGetter&) = delete;
+
+  inline T& get() const {
+    if (ready()) [[likely]] return val_;
+    return fetch();
   }
+  inline operator T&() const { return get(); }
 
   template <typename U>
   inline T& operator=(U&& v) {
     static_assert(std::is_assignable_v<T&, U>);
-    val_ = v;
-    return *this;
+    if (!ready()) {
+      // not to drop the getter while `fetch()` is calling it
+      if constexpr (SYNC) {
+        std::lock_guard lock {mutex_};
+        if (!ready()) {
+          emplace(std::forward<U>(v));
+          return val_;
+        }
+      } else {
+        emplace(std::forward<U>(v));
+        return val_;
+      }
+    }
+    val_ = std::forward<U>(v);
+    return val_;
   }
 
-  inline bool operator==(const T rhs) const {
-    return static_cast<T&>(*this) == rhs;
-  }
+  inline bool operator==(const T rhs) const { return get() == rhs; }
 
  private:
-  mutable std::variant<T, GETTER> val_;
-  mutable std::once_flag flag_;
+  inline bool ready() const {
+    if constexpr (SYNC) return ready_.load(std::memory_order_acquire);
+    else return ready_;
+  }
+
+  // The getter stays intact if constructing the value throws.
+  template <typename U>
+  void emplace(U&& v) const {
+    if constexpr (std::is_nothrow_constructible_v<T, U>) {
+      getter_.~GETTER();
+      ::new (static_cast<void*>(std::addressof(val_))) T(std::forward<U>(v));
+    } else {
+      T tmp(std::forward<U>(v));
+      getter_.~GETTER();
+      ::new (static_cast<void*>(std::addressof(val_))) T(std::move(tmp));
+    }
+    if constexpr (SYNC) ready_.store(true, std::memory_order_release);
+    else ready_ = true;
+  }
+
+  [[gnu::noinline]] T& fetch() const {
+    if constexpr (SYNC) {
+      std::lock_guard lock {mutex_};
+      if (!ready()) emplace(std::invoke(getter_));
+    } else {
+      emplace(std::invoke(getter_));
+    }
+    return val_;
+  }
+
+  union {
+    mutable GETTER getter_;
+    mutable T val_;
+  };
+  mutable std::conditional_t<SYNC, std::atomic<bool>, bool> ready_ {false};
+  struct no_mutex {};
+  [[no_unique_address]] mutable std::conditional_t<SYNC, std::mutex, no_mutex> mutex_;
 
  private:
   friend inline bool operator==(const T lhs, const LazyGetter &rhs) {
@@ -51,4 +111,33 @@ class LazyGetter {
   }
 };
 
+/// `LazyGetter` without synchronization, for single threaded contexts.
+template <typename GETTER>
+using UnsyncLazyGetter = LazyGetter<GETTER, false>;
+
+/// Fetches values of given `LazyGetter`s at once, each on a thread of its
+/// own. Rethrows the first exception after all of them are done.
+template <typename...GETTERS, bool...SYNC>
+  requires (sizeof...(GETTERS) > 0)
+void prefetch(const LazyGetter<GETTERS, SYNC>&...getters)
+{
+  std::exception_ptr errors[sizeof...(getters)];
+  std::vector<std::thread> threads;
+  threads.reserve(sizeof...(getters));
+  // joins those started so far if starting another throws
+  Defer join {[&threads] { for (auto &t : threads) t.join(); }};
+
+  size_t i = 0;
+  (threads.emplace_back([&getter = getters, &error = errors[i++]] {
+      try {
+        static_cast<void>(getter.get());
+      } catch (...) {
+        error = std::current_exception();
+      }
+    }), ...);
+  join();
+
+  for (const auto &e : errors) if (e) std::rethrow_exception(e);
+}
+
 }  // namespace gh4ck3r
@@ -1,53 +1,124 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <ostream>
 #include <streambuf>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace gh4ck3r {
 
+/// Inserts indentation at the start of every line written through it. With
+/// `buf_siz`, output is kept in a put area of that size until it's full or
+/// synced; otherwise it's written through as it comes.
 class indent_ostreambuf : public std::streambuf {
  public:
-  indent_ostreambuf(std::streambuf* sbuf)
-    : sbuf(sbuf) , need_prefix(true), nindent(0)
-  {}
+  indent_ostreambuf(std::streambuf* sbuf, const size_t buf_siz = 0)
+    : sbuf(sbuf), buf_(buf_siz ? new char[buf_siz] : nullptr)
+    , need_prefix(true), nindent(0)
+  {
+    setp(buf_.get(), buf_.get() + buf_siz);
+  }
+  ~indent_ostreambuf() override { drain(); }
 
  private:
   std::streambuf* sbuf;
-  bool            need_prefix;
+  std::unique_ptr<char[]> buf_;
+  std::string prefix_;
 
-  inline int sync() override { return sbuf->pubsync(); }
+  inline int sync() override { return drain() ? sbuf->pubsync() : -1; }
 
   int overflow(int c) override {
-    if (c != traits_type::eof()) {
+    if (!drain()) return traits_type::eof();
+    if (c == traits_type::eof()) return traits_type::not_eof(c);
+    if (pptr() != epptr()) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+      return c;
+    }
+    const auto ch = traits_type::to_char_type(c);
+    return put(&ch, 1) ? c : traits_type::eof();
+  }
+
+  std::streamsize xsputn(const char* s, const std::streamsize n) override {
+    if (n <= 0) return 0;
+    if (n > epptr() - pptr()) {
+      if (!drain()) return 0;
+      if (n > epptr() - pptr()) return put(s, static_cast<size_t>(n)) ? n : 0;
+    }
+    std::memcpy(pptr(), s, static_cast<size_t>(n));
+    pbump(static_cast<int>(n));
+    return n;
+  }
+
+  // Writes runs of whole lines to `sbuf`, prefixing those at line starts.
+  bool put(const char* p, size_t n) {
+    while (n) {
       if (need_prefix && nindent) {
-        const std::string prefix(nindent, ' ');
-        if (const auto nput = sbuf->sputn(prefix.data(), nindent);
+        if (prefix_.size() != nindent) prefix_.assign(nindent, ' ');
+        if (const auto nput = sbuf->sputn(prefix_.data(), static_cast<std::streamsize>(nindent));
             static_cast<size_t>(nput) != nindent)
         {
-          return std::char_traits<char>::eof();
+          return false;
         }
       }
-      need_prefix = c == '\n';
+      const auto nl = static_cast<const char*>(std::memchr(p, '\n', n));
+      const auto len = nl ? static_cast<size_t>(nl - p + 1) : n;
+      if (const auto nput = sbuf->sputn(p, static_cast<std::streamsize>(len));
+          static_cast<size_t>(nput) != len)
+      {
+        return false;
+      }
+      need_prefix = nl;
+      p += len;
+      n -= len;
     }
-    return sbuf->sputc(c);
+    return true;
   }
 
  protected:
+  bool   need_prefix;
   size_t nindent;
+
+  // Writes out the put area; indentation changes have to come after it.
+  bool drain() {
+    const auto n = static_cast<size_t>(pptr() - pbase());
+    if (!n) return true;
+    setp(pbase(), epptr());
+    return put(pbase(), n);
+  }
 };
 
-class indent_ostream : private virtual indent_ostreambuf, public std::ostream {
+class indent_ostream : protected virtual indent_ostreambuf, public std::ostream {
   static constexpr size_t indent_level_ = 2;
  public:
   indent_ostream() = delete;
-  indent_ostream(std::ostream& out) : indent_ostreambuf(out.rdbuf())
+  indent_ostream(std::ostream& out, const size_t buf_siz = 0)
+    : indent_ostreambuf(out.rdbuf(), buf_siz)
+    , std::ios(static_cast<std::streambuf*>(this))
+    , std::ostream(static_cast<std::streambuf*>(this))
+  {}
+  indent_ostream(std::streambuf* sbuf, const size_t buf_siz = 0)
+    : indent_ostreambuf(sbuf, buf_siz)
     , std::ios(static_cast<std::streambuf*>(this))
     , std::ostream(static_cast<std::streambuf*>(this))
   {}
   virtual ~indent_ostream() = default;
 
   inline void indent(const size_t nlevel = 1) {
+    drain();
     nindent += nlevel * indent_level_; };
   inline void unindent(const size_t nlevel = 1) {
+    drain();
     nindent -= nlevel * indent_level_;
   };
 
@@ -78,4 +149,381 @@ using Logger = indent_ostream;
 using indent = Logger::do_indent<true>;
 using unindent = Logger::do_indent<false>;
 
+namespace detail::logger {
+
+// Bounded byte ring of length prefixed records for a single producer and a
+// single consumer. The producer may also discard the oldest records to make
+// room, so the consumer claims a record by CAS on `head_` after copying it
+// and drops the copy if the producer took it over in the meantime. As in a
+// seqlock, that copy may overlap the producer's writes, so the ring is made
+// of words accessed through relaxed atomics and records are padded to them.
+class record_ring {
+  using word_t = uint64_t;
+  using len_t = uint32_t;
+  static constexpr size_t word_siz = sizeof(word_t);
+
+  // bytes a record of `len` takes up including its length word
+  static constexpr size_t footprint(const size_t len) {
+    return word_siz + (len + word_siz - 1) / word_siz * word_siz;
+  }
+
+ public:
+  explicit record_ring(const size_t capacity)
+    : buf_(new word_t[std::bit_ceil(std::max<size_t>(capacity, 64)) / word_siz])
+    , mask_(std::bit_ceil(std::max<size_t>(capacity, 64)) - 1)
+  {}
+
+  inline size_t capacity() const { return mask_ + 1; }
+  inline bool fits(const size_t len) const {
+    return footprint(len) <= capacity() && len <= std::numeric_limits<len_t>::max();
+  }
+  inline bool empty() const {
+    return head_.load(std::memory_order_acquire)
+      == tail_.load(std::memory_order_acquire);
+  }
+
+  // Producer side; false if there isn't room for `rec`.
+  bool try_push(const std::string_view rec) {
+    const auto t = tail_.load(std::memory_order_relaxed);
+    if (capacity() - (t - head_.load(std::memory_order_acquire)) < footprint(rec.size()))
+      return false;
+    commit(t, rec);
+    return true;
+  }
+
+  // Producer side; waits for the consumer while there isn't room for `rec`.
+  void push_wait(const std::string_view rec) {
+    const auto t = tail_.load(std::memory_order_relaxed);
+    for (auto h = head_.load(std::memory_order_acquire);
+        capacity() - (t - h) < footprint(rec.size());
+        h = head_.load(std::memory_order_acquire))
+    {
+      head_.wait(h, std::memory_order_acquire);
+    }
+    commit(t, rec);
+  }
+
+  // Producer side; discards the oldest records until `rec` fits and returns
+  // the number of them.
+  size_t push_overwrite(const std::string_view rec) {
+    const auto t = tail_.load(std::memory_order_relaxed);
+    size_t ndiscard = 0;
+    for (auto h = head_.load(std::memory_order_acquire);
+        capacity() - (t - h) < footprint(rec.size());)
+    {
+      const auto len = length_at(h);
+      if (head_.compare_exchange_weak(h, h + footprint(len),
+            std::memory_order_acq_rel, std::memory_order_acquire))
+      {
+        ++ndiscard;
+        h += footprint(len);
+      }
+    }
+    commit(t, rec);
+    return ndiscard;
+  }
+
+  // Consumer side; appends all available records to `out` and returns the
+  // number of them.
+  size_t drain(std::string& out) {
+    size_t n = 0;
+    auto h = head_.load(std::memory_order_acquire);
+    for (auto t = tail_.load(std::memory_order_acquire); h != t;) {
+      const auto len = length_at(h);
+      const auto off = out.size();
+      if (footprint(len) <= t - h) [[likely]] {
+        out.resize(off + len);
+        get(h + word_siz, out.data() + off, len);
+        if (head_.compare_exchange_strong(h, h + footprint(len),
+              std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+          h += footprint(len);
+          ++n;
+          continue;
+        }
+        out.resize(off);
+      } else {
+        // torn length of a record being overwritten
+        h = head_.load(std::memory_order_acquire);
+      }
+      t = tail_.load(std::memory_order_acquire);
+    }
+    if (n) head_.notify_one();
+    return n;
+  }
+
+ private:
+  std::unique_ptr<word_t[]> buf_;
+  size_t mask_;
+  alignas(64) std::atomic<uint64_t> head_ {0};
+  alignas(64) std::atomic<uint64_t> tail_ {0};
+
+  void commit(const uint64_t t, const std::string_view rec) {
+    word(t).store(rec.size(), std::memory_order_relaxed);
+    put(t + word_siz, rec.data(), rec.size());
+    tail_.store(t + footprint(rec.size()), std::memory_order_release);
+  }
+
+  inline std::atomic_ref<word_t> word(const uint64_t pos) const {
+    return std::atomic_ref {buf_[(pos & mask_) / word_siz]};
+  }
+
+  inline len_t length_at(const uint64_t pos) const {
+    return static_cast<len_t>(word(pos).load(std::memory_order_relaxed));
+  }
+
+  // `pos` is at a word boundary; the last word is padded with zeros.
+  void put(uint64_t pos, const char* src, const size_t len) {
+    for (size_t i = 0; i < len; i += word_siz, pos += word_siz) {
+      word_t w = 0;
+      std::memcpy(&w, src + i, std::min(word_siz, len - i));
+      word(pos).store(w, std::memory_order_relaxed);
+    }
+  }
+
+  void get(uint64_t pos, char* dst, const size_t len) const {
+    for (size_t i = 0; i < len; i += word_siz, pos += word_siz) {
+      const auto w = word(pos).load(std::memory_order_relaxed);
+      std::memcpy(dst + i, &w, std::min(word_siz, len - i));
+    }
+  }
+};
+
+class string_appendbuf : public std::streambuf {
+ public:
+  std::string str;
+
+ private:
+  int overflow(int c) override {
+    if (c != traits_type::eof()) str.push_back(static_cast<char>(c));
+    return traits_type::not_eof(c);
+  }
+  std::streamsize xsputn(const char* s, std::streamsize n) override {
+    str.append(s, static_cast<size_t>(n));
+    return n;
+  }
+};
+
+} // namespace detail::logger
+
+/// Logger formatting records on the calling thread and writing them to the
+/// sink from a background thread. A record is everything streamed in one
+/// expression, e.g. `logger << "hello " << name << '\n';`. Indentation is kept
+/// per thread, so `indent`/`unindent` work as they do with `Logger`.
+class AsyncLogger {
+ public:
+  enum class overflow_policy {
+    block,      // wait for the background thread to make room
+    drop,       // discard the new record
+    overwrite,  // discard the oldest records
+  };
+
+  struct options {
+    size_t ring_siz {64 * 1024};    // per producer thread
+    size_t batch_siz {64 * 1024};   // size of writes to the sink
+    overflow_policy policy {overflow_policy::block};
+  };
+
+ private:
+  struct producer {
+    explicit producer(const size_t ring_siz) : ring(ring_siz) {}
+
+    detail::logger::record_ring ring;
+    detail::logger::string_appendbuf sbuf;
+    size_t nindent {0};
+    bool need_prefix {true};
+    std::atomic<bool> orphan {false};
+  };
+
+ public:
+  class Record : public indent_ostream {
+   public:
+    Record(const Record&) = delete;
+    Record& operator=(const Record&) = delete;
+    ~Record() { logger_.commit(p_, off_, nindent, need_prefix); }
+
+   private:
+    friend class AsyncLogger;
+
+    Record(AsyncLogger& logger, producer& p)
+      : indent_ostreambuf(&p.sbuf), indent_ostream(&p.sbuf)
+      , logger_(logger), p_(p), off_(p.sbuf.str.size())
+    {
+      nindent = p.nindent;
+      need_prefix = p.need_prefix;
+    }
+
+    template <typename T>
+    Record(AsyncLogger& logger, producer& p, T&& v) : Record(logger, p) {
+      static_cast<std::ostream&>(*this) << std::forward<T>(v);
+    }
+
+    AsyncLogger& logger_;
+    producer& p_;
+    const size_t off_;
+  };
+
+  explicit AsyncLogger(std::ostream& out) : AsyncLogger(out, options{}) {}
+  AsyncLogger(std::ostream& out, const options opts)
+    : sbuf_(out.rdbuf()), opts_(opts), worker_([this] { run(); })
+  {}
+  AsyncLogger(const AsyncLogger&) = delete;
+  AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+  ~AsyncLogger() {
+    stop_.store(true, std::memory_order_release);
+    wakeup();
+    worker_.join();
+  }
+
+  inline Record record() { return Record{*this, local()}; }
+
+  template <typename T>
+  inline Record operator<<(T&& v) {
+    return Record{*this, local(), std::forward<T>(v)};
+  }
+  inline Record operator<<(std::ostream& (*manip)(std::ostream&)) {
+    return Record{*this, local(), manip};
+  }
+
+  /// Waits until records logged so far are written and the sink is synced.
+  void flush() {
+    const auto ticket = flush_req_.fetch_add(1, std::memory_order_acq_rel) + 1;
+    wakeup();
+    for (auto done = flushed_.load(std::memory_order_acquire); done < ticket;
+        done = flushed_.load(std::memory_order_acquire))
+    {
+      flushed_.wait(done, std::memory_order_acquire);
+    }
+  }
+
+  /// Number of records discarded by `drop`/`overwrite` policies or for not
+  /// fitting in the ring at all.
+  inline size_t dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::streambuf* const sbuf_;
+  const options opts_;
+  const uint64_t id_ {next_id()};
+
+  std::mutex producers_mtx_;
+  std::vector<std::shared_ptr<producer>> producers_;
+
+  std::atomic<uint32_t> signal_ {0};
+  std::atomic<bool> stop_ {false};
+  std::atomic<uint64_t> flush_req_ {0};
+  std::atomic<uint64_t> flushed_ {0};
+  std::atomic<size_t> dropped_ {0};
+
+  std::thread worker_;
+
+  static uint64_t next_id() {
+    static std::atomic<uint64_t> id {0};
+    return id.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Producer of the calling thread. Loggers are told apart by id rather than
+  // address since the address may be reused by a later logger.
+  producer& local() {
+    struct cache_t {
+      std::vector<std::pair<uint64_t, std::shared_ptr<producer>>> entries;
+      ~cache_t() { for (auto& [_, p] : entries) p->orphan = true; }
+    };
+    thread_local cache_t cache;
+
+    for (auto& [id, p] : cache.entries) if (id == id_) [[likely]] return *p;
+
+    // first record of this thread; forget loggers gone away.
+    std::erase_if(cache.entries, [](const auto& e) { return e.second.use_count() == 1; });
+    auto p = std::make_shared<producer>(opts_.ring_siz);
+    {
+      std::lock_guard lock {producers_mtx_};
+      producers_.push_back(p);
+    }
+    return *cache.entries.emplace_back(id_, std::move(p)).second;
+  }
+
+  void commit(producer& p, const size_t off, const size_t nindent, const bool need_prefix) {
+    p.nindent = nindent;
+    p.need_prefix = need_prefix;
+
+    auto& str = p.sbuf.str;
+    const std::string_view rec {str.data() + off, str.size() - off};
+    if (rec.empty()) return;
+
+    if (!p.ring.fits(rec.size())) [[unlikely]] {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+    } else switch (opts_.policy) {
+      case overflow_policy::block:
+        if (!p.ring.try_push(rec)) {
+          wakeup();
+          p.ring.push_wait(rec);
+        }
+        break;
+      case overflow_policy::drop:
+        if (!p.ring.try_push(rec)) dropped_.fetch_add(1, std::memory_order_relaxed);
+        break;
+      case overflow_policy::overwrite:
+        if (const auto n = p.ring.push_overwrite(rec); n) {
+          dropped_.fetch_add(n, std::memory_order_relaxed);
+        }
+        break;
+    }
+    str.resize(off);
+    wakeup();
+  }
+
+  inline void wakeup() {
+    signal_.fetch_add(1, std::memory_order_release);
+    signal_.notify_one();
+  }
+
+  void run() {
+    std::vector<std::shared_ptr<producer>> producers;
+    std::string batch;
+    batch.reserve(opts_.batch_siz);
+
+    for (;;) {
+      const auto sig = signal_.load(std::memory_order_acquire);
+      const auto stop = stop_.load(std::memory_order_acquire);
+      const auto req = flush_req_.load(std::memory_order_acquire);
+      {
+        std::lock_guard lock {producers_mtx_};
+        // A producer orphaned by its thread is dropped once drained.
+        std::erase_if(producers_, [](const auto& p) {
+            return p->orphan.load(std::memory_order_acquire) && p->ring.empty();
+          });
+        producers = producers_;
+      }
+
+      bool idle = true;
+      for (auto& p : producers) {
+        while (p->ring.drain(batch)) {
+          idle = false;
+          if (batch.size() >= opts_.batch_siz) {
+            sbuf_->sputn(batch.data(), static_cast<std::streamsize>(batch.size()));
+            batch.clear();
+          }
+        }
+      }
+      if (!batch.empty()) {
+        sbuf_->sputn(batch.data(), static_cast<std::streamsize>(batch.size()));
+        batch.clear();
+      }
+
+      if (!idle) continue;
+      if (flushed_.load(std::memory_order_relaxed) < req) {
+        sbuf_->pubsync();
+        flushed_.store(req, std::memory_order_release);
+        flushed_.notify_all();
+      }
+      if (stop) break;
+      signal_.wait(sig, std::memory_order_acquire);
+    }
+    sbuf_->pubsync();
+  }
+};
+
 } // namespace gh4ck3r
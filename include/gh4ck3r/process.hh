@@ -1,21 +1,37 @@
 #pragma once
 #include <algorithm>
+#include <array>
+#include <charconv>
 #include <chrono>
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
 #include <iterator>
+#include <limits>
 #include <map>
+#include <memory>
+#include <optional>
+#include <span>
 #include <sstream>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
 #include <vector>
+#include <climits>
 #include <csignal>
+#include <cstring>
+#include <gh4ck3r/defer.hh>
 #include <gh4ck3r/file.hh>
 
 extern "C" {
 #include <fcntl.h>
 #include <unistd.h>
 #include <poll.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <sys/pidfd.h>
 #include <sys/syscall.h>
@@ -29,71 +45,228 @@ using path_t = std::filesystem::path;
 
 inline const path_t proc_dir {"/proc"};
 
-class Argv : protected std::vector<std::string> {
+namespace detail {
+
+// Pointers into an arena which are rebuilt on demand. A copy starts out
+// stale since the pointers refer to the arena of the original.
+struct ptr_cache {
+  std::vector<const char *> ptrs;
+  bool valid {false};
+
+  ptr_cache() = default;
+  ptr_cache(const ptr_cache&) {}
+  ptr_cache& operator=(const ptr_cache&) { valid = false; return *this; }
+};
+
+} // namespace detail
+
+/// Arguments packed back to back into a single buffer. The `argv` array
+/// handed to exec is built once and reused until the next change.
+class Argv {
   using argv_t = char *const *;
-  mutable std::vector<const char *> ptrs_;
 
  public:
-  Argv(std::initializer_list<value_type> init) : vector(init) {}
+  Argv() = default;
+  Argv(std::initializer_list<std::string_view> init) {
+    size_t siz = 0;
+    for (const auto arg : init) siz += arg.size() + 1;
+    arena_.reserve(siz);
+    offs_.reserve(init.size());
+    for (const auto arg : init) emplace_back(arg);
+  }
 
-  using vector::front;
-  using vector::size;
-  using vector::emplace_back;
+  inline std::string_view operator[](const size_t i) const { return arena_.data() + offs_[i]; }
+  inline std::string_view front() const { return (*this)[0]; }
+  inline size_t size() const { return offs_.size(); }
 
-  inline operator argv_t() const {
-    ptrs_.clear();
-    ptrs_.reserve(size());
-    std::transform(begin(), end(), std::back_inserter(ptrs_),
-                   [] (auto &s) { return s.data(); });
-    ptrs_.push_back(nullptr);
+  inline std::string_view emplace_back(const std::string_view arg) {
+    offs_.emplace_back(arena_.size());
+    arena_.append(arg).push_back('\0');
+    cache_.valid = false;
+    return (*this)[offs_.size() - 1];
+  }
 
-    return const_cast<argv_t>(ptrs_.data());
+  inline operator argv_t() const {
+    if (!cache_.valid) {
+      cache_.ptrs.clear();
+      cache_.ptrs.reserve(offs_.size() + 1);
+      for (const auto off : offs_) cache_.ptrs.push_back(arena_.data() + off);
+      cache_.ptrs.push_back(nullptr);
+      cache_.valid = true;
+    }
+    return const_cast<argv_t>(cache_.ptrs.data());
   }
+
+ private:
+  std::string arena_;
+  std::vector<size_t> offs_;
+  mutable detail::ptr_cache cache_;
 };
 
-class Env : protected std::map<std::string, std::string> {
+/// Environment of `key=value` entries packed into a single buffer along
+/// with the `envp` array pointing into it, both shared between copies.
+/// Changes to a copy are kept aside and merged into a fresh buffer the next
+/// time it is read, so deriving from a large base environment costs only
+/// what's changed.
+class Env {
   using envp_t = char *const *;
-  mutable std::vector<std::string> buf_;
-  mutable std::vector<const char *> ptrs_;
+
+  // immutable once built; entries are sorted by key
+  struct block {
+    std::string arena;
+    std::vector<const char *> ptrs;
+
+    inline size_t size() const { return ptrs.size() - 1; }
+  };
+
+  static inline std::string_view key_of(const std::string_view entry) {
+    return entry.substr(0, entry.find('='));
+  }
+  static inline std::string_view value_of(const std::string_view entry) {
+    return entry.substr(entry.find('=') + 1);
+  }
 
  public:
-  Env(char *const * envp = environ) {
-    if (!envp || !*envp) return;
+  using value_type = std::pair<std::string_view, std::string_view>;
+
+  class iterator {
+   public:
+    using value_type = Env::value_type;
+    using difference_type = std::ptrdiff_t;
+
+    iterator() = default;
+    explicit iterator(const char * const *p) : p_(p) {}
+
+    inline value_type operator*() const { return {key_of(*p_), value_of(*p_)}; }
+    inline iterator& operator++() { ++p_; return *this; }
+    inline iterator operator++(int) { auto it = *this; ++p_; return it; }
+    inline bool operator==(const iterator&) const = default;
+
+   private:
+    const char * const *p_ {nullptr};
+  };
+
+  /// Assigns through `Env::set()` so that the change is noticed.
+  class entry {
+   public:
+    entry(Env &env, const std::string_view key) : env_(env), key_(key) {}
+    inline entry& operator=(const std::string_view value) {
+      env_.set(key_, value);
+      return *this;
+    }
+    inline operator std::string_view() const { return env_.get(key_).value_or(""); }
+
+   private:
+    Env &env_;
+    std::string key_;
+  };
 
-    std::string_view env {*envp};
-    while (!env.empty()) {
-      const auto pos = env.find('=');
-      if (pos == env.npos) [[unlikely]]
+  Env(char *const * envp = environ) {
+    std::vector<value_type> entries;
+    for (; envp && *envp; ++envp) {
+      const std::string_view env {*envp};
+      if (env.find('=') == env.npos) [[unlikely]]
         throw std::invalid_argument {"Env entry should have '='" + std::string{env}};
+      entries.emplace_back(key_of(env), value_of(env));
+    }
+    // the last one wins on duplicated keys
+    std::stable_sort(entries.begin(), entries.end(),
+        [] (auto &l, auto &r) { return l.first < r.first; });
+    const auto last = std::unique(entries.rbegin(), entries.rend(),
+        [] (auto &l, auto &r) { return l.first == r.first; });
+    entries.erase(entries.begin(), last.base());
+    base_ = make_block(entries);
+  }
+
+  /// Copy of `base` with `overrides` applied on top of it.
+  Env(const Env &base, std::initializer_list<value_type> overrides) : Env(base) {
+    for (const auto &[k, v] : overrides) set(k, v);
+  }
+
+  inline iterator begin() const { return iterator {materialize().ptrs.data()}; }
+  inline iterator end() const {
+    const auto &b = materialize();
+    return iterator {b.ptrs.data() + b.size()};
+  }
+  inline size_t size() const { return materialize().size(); }
+  inline bool empty() const { return !size(); }
 
-      insert_or_assign(std::string{env.substr(0, pos)}, std::string{env.substr(pos + 1)});
+  inline void clear() {
+    base_ = make_block({});
+    changes_.clear();
+  }
 
-      env = (*++envp) ? *envp : std::string_view{};
+  std::optional<std::string_view> get(const std::string_view key) const {
+    if (const auto it = changes_.find(key); it != changes_.end()) {
+      if (!it->second) return std::nullopt;
+      return *it->second;
     }
+    const auto &ptrs = base_->ptrs;
+    const auto it = std::lower_bound(ptrs.begin(), ptrs.end() - 1, key,
+        [] (const char *entry, const std::string_view k) { return key_of(entry) < k; });
+    if (it == ptrs.end() - 1 || key_of(*it) != key) return std::nullopt;
+    return value_of(*it);
   }
 
-  using map::begin;
-  using map::end;
-  using map::clear;
-  using map::size;
-  using map::operator[];
+  inline void set(const std::string_view key, const std::string_view value) {
+    if (key.empty() || key.find('=') != key.npos) [[unlikely]]
+      throw std::invalid_argument {"invalid Env key: " + std::string{key}};
+    changes_.insert_or_assign(std::string{key}, std::string{value});
+  }
+  inline void erase(const std::string_view key) {
+    changes_.insert_or_assign(std::string{key}, std::nullopt);
+  }
+
+  inline entry operator[](const std::string_view key) { return {*this, key}; }
+  inline std::string_view operator[](const std::string_view key) const {
+    return get(key).value_or("");
+  }
 
   inline operator envp_t() const {
-    buf_.clear();
+    return const_cast<envp_t>(materialize().ptrs.data());
+  }
+
+ private:
+  static std::shared_ptr<const block> make_block(const std::vector<value_type> &entries) {
+    auto b = std::make_shared<block>();
+    size_t siz = 0;
+    for (const auto &[k, v] : entries) siz += k.size() + v.size() + 2;
+    b->arena.reserve(siz);
+    std::vector<size_t> offs;
+    offs.reserve(entries.size());
+    for (const auto &[k, v] : entries) {
+      offs.push_back(b->arena.size());
+      b->arena.append(k).append(1, '=').append(v).push_back('\0');
+    }
+    b->ptrs.reserve(entries.size() + 1);
+    for (const auto off : offs) b->ptrs.push_back(b->arena.data() + off);
+    b->ptrs.push_back(nullptr);
+    return b;
+  }
 
-    const auto siz = size();
-    buf_.reserve(siz);
-    std::transform(begin(), end(), std::back_inserter(buf_),
-                   [] (auto &kv) { return kv.first + '=' + kv.second; });
+  // Merges pending changes into a new block, leaving copies sharing the
+  // current one as they are.
+  const block &materialize() const {
+    if (changes_.empty()) [[likely]] return *base_;
 
-    ptrs_.clear();
-    ptrs_.reserve(siz + 1);
-    std::transform(buf_.begin(), buf_.end(), std::back_inserter(ptrs_),
-                   [] (auto &s) { return s.data(); });
-    ptrs_.emplace_back(nullptr);
+    std::vector<value_type> entries;
+    entries.reserve(base_->size() + changes_.size());
+    auto it = base_->ptrs.begin();
+    const auto last = base_->ptrs.end() - 1;
+    for (const auto &[k, v] : changes_) {
+      for (; it != last && key_of(*it) < k; ++it) entries.emplace_back(key_of(*it), value_of(*it));
+      if (it != last && key_of(*it) == k) ++it;
+      if (v) entries.emplace_back(k, *v);
+    }
+    for (; it != last; ++it) entries.emplace_back(key_of(*it), value_of(*it));
 
-    return const_cast<envp_t>(ptrs_.data());
+    base_ = make_block(entries);
+    changes_.clear();
+    return *base_;
   }
+
+  mutable std::shared_ptr<const block> base_;
+  mutable std::map<std::string, std::optional<std::string>, std::less<>> changes_;
 };
 
 inline path_t operator/(const path_t &path, pid_t pid) {
@@ -308,13 +481,13 @@ inline filesystem::unique_fd pidfd_open(pid_t pid, unsigned int flags)
   return {fd};
 }
 
-inline int wait(const pid_t pid)
-{
-  const auto pid_fd {pidfd_open(pid, 0)};
+namespace detail {
 
+inline int wait_pidfd(const filesystem::fd_t pid_fd)
+{
   auto ec {static_cast<int>(exit_code::out_of_range)};
   if (siginfo_t siginfo;
-      ::waitid(P_PIDFD, static_cast<int>(pid_fd), &siginfo, WEXITED) == 0)
+      ::waitid(P_PIDFD, static_cast<id_t>(pid_fd), &siginfo, WEXITED) == 0)
   {
     ec = siginfo.si_code == CLD_EXITED ? siginfo.si_status :
       static_cast<int>(exit_code::signaled) + siginfo.si_status;
@@ -323,15 +496,13 @@ inline int wait(const pid_t pid)
   return ec;
 }
 
-inline int wait_for(const pid_t pid, const std::chrono::nanoseconds &d)
+inline void poll_pidfd(const filesystem::fd_t pid_fd,
+                       const pid_t pid,
+                       const std::chrono::nanoseconds &d)
 {
-  if (pid <= 0) [[unlikely]] throw std::invalid_argument {
-    "pid should be positive to specify exact one process: " + std::to_string(pid)};
-  else if (d < d.zero()) [[unlikely]] throw std::invalid_argument {
+  if (d < d.zero()) [[unlikely]] throw std::invalid_argument {
     "duration must be positive for waiting process termination: " + std::to_string(pid)};
 
-  const filesystem::unique_fd pid_fd {pidfd_open(pid, 0)};
-
   struct pollfd pfd {
     .fd = pid_fd,
     .events = POLLIN,
@@ -339,33 +510,630 @@ inline int wait_for(const pid_t pid, const std::chrono::nanoseconds &d)
   };
   const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(d).count();
 
-  const auto ret = ::poll(&pfd, 1, ms);
+  const auto ret = ::poll(&pfd, 1, static_cast<int>(ms));
   if (ret == 0) {
     throw timeout_error {pid, d};
   } else if (ret < 0) {
     throw std::system_error {errno, std::system_category(), "failed to poll pidfd"};
   }
+}
+
+} // namespace detail
+
+inline int wait(const pid_t pid)
+{
+  const auto pid_fd {pidfd_open(pid, 0)};
+  return detail::wait_pidfd(pid_fd);
+}
+
+inline int wait_for(const pid_t pid, const std::chrono::nanoseconds &d)
+{
+  if (pid <= 0) [[unlikely]] throw std::invalid_argument {
+    "pid should be positive to specify exact one process: " + std::to_string(pid)};
+
+  const filesystem::unique_fd pid_fd {pidfd_open(pid, 0)};
+  detail::poll_pidfd(pid_fd, pid, d);
+
+  return detail::wait_pidfd(pid_fd);
+}
+
+/// Child process launched by `spawn` along with its pidfd.
+struct Child {
+  pid_t pid;
+  filesystem::unique_fd pidfd;
+};
+
+inline int wait(const Child &child) { return detail::wait_pidfd(child.pidfd); }
+
+inline int wait_for(const Child &child, const std::chrono::nanoseconds &d)
+{
+  detail::poll_pidfd(child.pidfd, child.pid, d);
+  return detail::wait_pidfd(child.pidfd);
+}
+
+/// Alternative to `execute` built on posix_spawn(3). glibc launches the
+/// child with CLONE_VM | CLONE_VFORK, so the cost doesn't grow with the
+/// parent's page tables, and exec failures are reported to the caller
+/// instead of an exit code. The pidfd is obtained before the child can be
+/// reaped, which closes the pid reuse window `wait(pid_t)` has. glibc 2.39+
+/// hands it over from CLONE_PIDFD via pidfd_spawn(3) directly.
+[[nodiscard("A caller is responsible for waiting for the child process")]]
+inline Child spawn(const int stdin_fd,
+                   const int stdout_fd,
+                   const int stderr_fd,
+                   const path_t &file,
+                   const Argv &argv = {},
+                   const Env  &envp = environ)
+{
+  if (!is_executable(file))
+    throw std::invalid_argument {file.string() + " is not an executable"};
+
+  posix_spawn_file_actions_t actions;
+  if (const auto err = posix_spawn_file_actions_init(&actions); err) [[unlikely]]
+    throw std::system_error {err, std::system_category(), "posix_spawn_file_actions_init"};
+  const Defer destroy_actions {[&actions] {
+    posix_spawn_file_actions_destroy(&actions);
+  }};
+
+  // Same remapping as `set_stdio`
+  const std::array fd_map {
+    std::make_pair(stdin_fd, STDIN_FILENO),
+    std::make_pair(stdout_fd, STDOUT_FILENO),
+    std::make_pair(stderr_fd, STDERR_FILENO),
+  };
+  // Closes are queued after all dup2s, which may read the fds to close.
+  std::vector<int> close_fds;
+  for (const auto &[from, to] : fd_map) {
+    int err = 0;
+    if (from < 0) {
+      close_fds.emplace_back(to);
+    } else if (from != to) {
+      err = posix_spawn_file_actions_adddup2(&actions, from, to);
+      if (STDERR_FILENO < from &&
+          std::find(close_fds.begin(), close_fds.end(), from) == close_fds.end()) {
+        close_fds.emplace_back(from);
+      }
+    }
+    if (err) [[unlikely]] throw std::system_error {err, std::system_category(),
+      "failed to set stdio: " + std::to_string(from) + " -> " + std::to_string(to)};
+  }
+  for (const auto fd : close_fds) {
+    if (const auto err = posix_spawn_file_actions_addclose(&actions, fd); err)
+      [[unlikely]] throw std::system_error {err, std::system_category(),
+        "posix_spawn_file_actions_addclose"};
+  }
+
+  const Argv default_argv {file.c_str()};
+  const auto &args = argv.size() ? argv : default_argv;
+
+#if __GLIBC_PREREQ(2, 39)
+  int pidfd;
+  if (const auto err = ::pidfd_spawn(&pidfd, file.c_str(), &actions, nullptr, args, envp);
+      err) [[unlikely]]
+  {
+    throw std::system_error {err, std::system_category(),
+      "failed to spawn " + file.string()};
+  }
+  return {::pidfd_getpid(pidfd), filesystem::unique_fd {pidfd}};
+#else
+  pid_t pid;
+  if (const auto err = ::posix_spawn(&pid, file.c_str(), &actions, nullptr, args, envp);
+      err) [[unlikely]]
+  {
+    throw std::system_error {err, std::system_category(),
+      "failed to spawn " + file.string()};
+  }
+
+  const auto pidfd = ::pidfd_open(pid, 0);
+  if (pidfd == -1) [[unlikely]] {
+    const auto err = errno;
+    ::waitpid(pid, nullptr, 0);
+    throw std::system_error {err, std::system_category(),
+      "pidfd_open: failed to open " + std::to_string(pid)};
+  }
+  return {pid, filesystem::unique_fd {pidfd}};
+#endif
+}
+
+template <typename FIRST, typename...REST>
+requires (!std::is_same_v<Argv, std::decay_t<FIRST>>)
+[[nodiscard("A caller is responsible for waiting for the child process")]]
+Child spawn(const int stdin_fd,
+            const int stdout_fd,
+            const int stderr_fd,
+            const path_t &file,
+            FIRST&& first,
+            REST&&...rest) {
+  return spawn(stdin_fd, stdout_fd, stderr_fd,
+               file,
+               Argv {
+                file.c_str(),
+                detail::stringify(std::forward<FIRST>(first)),
+                (detail::stringify(std::forward<REST>(rest)))...
+               });
+}
+
+template <class...ARGS>
+[[nodiscard("A caller is responsible for waiting for the child process")]]
+inline Child spawn(const path_t &file, ARGS&&...args) {
+  return spawn(STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO,
+               file, std::forward<ARGS>(args)...);
+}
+
+namespace detail {
+
+/// Hashed timer wheel; scheduling and expiring cost O(1) per timer.
+/// Timers never fire early but may fire up to one tick late.
+template <typename T>
+class timer_wheel {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  explicit timer_wheel(const clock::duration tick = std::chrono::milliseconds {10},
+                       const size_t nslots = 256,
+                       const clock::time_point start = clock::now()) :
+    tick_(tick), start_(start), slots_(nslots)
+  {
+    if (tick_ <= tick_.zero() || !nslots) [[unlikely]]
+      throw std::invalid_argument {"timer_wheel: invalid tick or slots"};
+  }
+
+  void schedule(const clock::time_point deadline, T v) {
+    // round up so that the timer doesn't fire before its deadline; one
+    // already past, even before `start_`, fires on the next tick
+    const auto ticks = (deadline - start_ + tick_ - clock::duration {1}) / tick_;
+    const auto t = ticks <= static_cast<clock::rep>(current_) ?
+      current_ + 1 : static_cast<uint64_t>(ticks);
+    slots_[t % slots_.size()].emplace_back(t, std::move(v));
+    ++size_;
+  }
+
+  /// Expires every timer due by `now` through `fn(T&)`.
+  template <typename FN>
+  void advance(const clock::time_point now, FN &&fn) {
+    if (now < start_) return;
+    const auto target = static_cast<uint64_t>((now - start_) / tick_);
+    if (target <= current_) return;
+
+    // After a long stall every slot is visited once.
+    const auto nsteps = std::min<uint64_t>(target - current_, slots_.size());
+    for (uint64_t i = 1; i <= nsteps && size_; ++i) {
+      auto &slot = slots_[(current_ + i) % slots_.size()];
+      for (size_t j = 0; j < slot.size();) {
+        if (slot[j].first > target) { ++j; continue; }
+        auto v = std::move(slot[j].second);
+        slot[j] = std::move(slot.back());
+        slot.pop_back();
+        --size_;
+        fn(v);
+      }
+    }
+    current_ = target;
+  }
+
+  /// Time of the tick the earliest pending timer fires at, if any. A timer
+  /// in the first occupied slot for the current revolution ends the scan;
+  /// otherwise the slots hold only later revolutions and all are looked at.
+  std::optional<clock::time_point> next_deadline() const {
+    if (!size_) return std::nullopt;
+    auto earliest = std::numeric_limits<uint64_t>::max();
+    for (uint64_t i = 1; i <= slots_.size() && earliest > current_ + i; ++i) {
+      for (const auto &[t, v] : slots_[(current_ + i) % slots_.size()])
+        earliest = std::min(earliest, t);
+    }
+    return start_ + tick_ * static_cast<clock::rep>(earliest);
+  }
+
+  inline size_t size() const { return size_; }
+  inline bool empty() const { return !size_; }
+
+ private:
+  const clock::duration tick_;
+  const clock::time_point start_;
+  std::vector<std::vector<std::pair<uint64_t, T>>> slots_;
+  uint64_t current_ {0};
+  size_t size_ {0};
+};
+
+} // namespace detail
+
+/// Termination report of a child in `ChildSet`.
+struct Completion {
+  pid_t pid;
+  int status;           // encoded as `wait()` returns
+  struct rusage rusage;
+  bool timed_out;       // the deadline passed and the child was signaled
+};
+
+/// Supervises many children from a single thread. pidfds are registered in
+/// one epoll instance and children are reaped in batches with their rusage.
+/// Deadlines are kept in a timer wheel; an overdue child gets the signal
+/// given on `add` and is reported with `timed_out` once it terminates.
+class ChildSet {
+  using clock = std::chrono::steady_clock;
+
+  struct record {
+    filesystem::unique_fd pidfd;
+    int signal;
+    uint64_t seq;
+    bool timed_out;
+  };
+
+ public:
+  ChildSet() : epfd_(create_epoll()) {}
+
+  ChildSet(const ChildSet&) = delete;
+  ChildSet& operator=(const ChildSet&) = delete;
+
+  inline size_t size() const { return children_.size(); }
+  inline bool empty() const { return children_.empty(); }
+
+  void add(Child child,
+           const std::optional<std::chrono::nanoseconds> timeout = std::nullopt,
+           const int signal = SIGKILL)
+  {
+    struct epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = static_cast<uint64_t>(child.pid);
+    if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, child.pidfd, &ev) == -1) [[unlikely]]
+      throw std::system_error {errno, std::system_category(),
+        "failed to watch " + std::to_string(child.pid)};
+
+    const auto seq = ++seq_;
+    const auto [it, inserted] = children_.try_emplace(child.pid,
+        record {std::move(child.pidfd), signal, seq, false});
+    if (!inserted) [[unlikely]]
+      throw std::invalid_argument {"duplicated child: " + std::to_string(child.pid)};
+
+    if (timeout) timers_.schedule(clock::now() + *timeout, {it->first, seq});
+  }
+
+  inline void add(const pid_t pid,
+                  const std::optional<std::chrono::nanoseconds> timeout = std::nullopt,
+                  const int signal = SIGKILL)
+  {
+    add(Child {pid, pidfd_open(pid, 0)}, timeout, signal);
+  }
+
+  /// Waits up to `timeout` (forever if negative) for children to terminate
+  /// and appends their completions to `out`. Returns the number appended.
+  size_t reap(std::vector<Completion> &out,
+              const std::chrono::nanoseconds timeout = std::chrono::nanoseconds {-1})
+  {
+    const auto until = timeout < timeout.zero() ?
+      clock::time_point::max() : clock::now() + timeout;
+    const auto nout = out.size();
+
+    while (!children_.empty()) {
+      const auto now = clock::now();
+      timers_.advance(now, [this] (const auto &timer) { expire(timer); });
+
+      auto wake = until;
+      if (const auto deadline = timers_.next_deadline(); deadline)
+        wake = std::min(wake, *deadline);
+      const auto ms = wake == clock::time_point::max() ? -1 : static_cast<int>(
+          std::min<std::chrono::milliseconds::rep>(INT_MAX,
+            std::chrono::ceil<std::chrono::milliseconds>(
+              std::max(wake - now, clock::duration::zero())).count()));
+
+      const auto n = ::epoll_wait(epfd_, events_.data(),
+          static_cast<int>(events_.size()), ms);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        throw std::system_error {errno, std::system_category(), "epoll_wait"};
+      }
+
+      for (int i = 0; i < n; ++i)
+        collect(static_cast<pid_t>(events_[static_cast<size_t>(i)].data.u64), out);
+
+      if (out.size() != nout || clock::now() >= until) break;
+    }
+    return out.size() - nout;
+  }
+
+  std::vector<Completion> reap(
+      const std::chrono::nanoseconds timeout = std::chrono::nanoseconds {-1})
+  {
+    std::vector<Completion> out;
+    reap(out, timeout);
+    return out;
+  }
+
+ private:
+  static filesystem::unique_fd create_epoll() {
+    const auto fd = ::epoll_create1(EPOLL_CLOEXEC);
+    if (fd == -1) [[unlikely]]
+      throw std::system_error {errno, std::system_category(), "epoll_create1"};
+    return {fd};
+  }
+
+  void expire(const std::pair<pid_t, uint64_t> &timer) {
+    const auto it = children_.find(timer.first);
+    if (it == children_.end() || it->second.seq != timer.second) return;
+    it->second.timed_out = true;
+    ::syscall(SYS_pidfd_send_signal, static_cast<filesystem::fd_t>(it->second.pidfd),
+        it->second.signal, nullptr, 0);
+  }
+
+  void collect(const pid_t pid, std::vector<Completion> &out) {
+    const auto it = children_.find(pid);
+    if (it == children_.end()) [[unlikely]] return;
+
+    Completion c {pid, static_cast<int>(exit_code::out_of_range), {}, it->second.timed_out};
+    siginfo_t siginfo {};
+    // glibc's waitid(2) doesn't expose the rusage argument of the syscall.
+    if (::syscall(SYS_waitid, P_PIDFD, static_cast<filesystem::fd_t>(it->second.pidfd),
+          &siginfo, WEXITED | WNOHANG, &c.rusage) == -1) [[unlikely]]
+    {
+      throw std::system_error {errno, std::system_category(),
+        "failed to reap " + std::to_string(pid)};
+    }
+    if (!siginfo.si_pid) return;  // spurious wakeup
+
+    c.status = siginfo.si_code == CLD_EXITED ? siginfo.si_status :
+      static_cast<int>(exit_code::signaled) + siginfo.si_status;
+    out.emplace_back(c);
+
+    // closing the pidfd removes it from the epoll set as well
+    children_.erase(it);
+  }
+
+ private:
+  filesystem::unique_fd epfd_;
+  std::unordered_map<pid_t, record> children_;
+  detail::timer_wheel<std::pair<pid_t, uint64_t>> timers_;
+  std::array<struct epoll_event, 256> events_ {};
+  uint64_t seq_ {0};
+};
+
+namespace detail {
+
+// Fields of /proc/<pid>/stat, man proc_pid_stat
+struct proc_stat {
+  std::string_view comm;
+  char state;
+  pid_t ppid;
+  uint64_t utime;
+  uint64_t starttime;
+  int64_t rss;
+};
+
+// Reads space separated fields one after another.
+class field_scanner {
+ public:
+  explicit field_scanner(const std::string_view s) : s_(s) {}
+
+  inline void skip(size_t n) {
+    while (n--) next();
+  }
+  inline std::string_view next() {
+    const auto beg = std::min(s_.find_first_not_of(' '), s_.size());
+    const auto end = std::min(s_.find(' ', beg), s_.size());
+    const auto field = s_.substr(beg, end - beg);
+    s_.remove_prefix(end);
+    return field;
+  }
+  template <typename T>
+  inline T next() {
+    const auto field = next();
+    T v {};
+    if (const auto [p, ec] = std::from_chars(field.data(), field.data() + field.size(), v);
+        ec != std::errc {}) [[unlikely]]
+    {
+      throw std::runtime_error {"invalid field in /proc/<pid>/stat: " + std::string{field}};
+    }
+    return v;
+  }
+
+ private:
+  std::string_view s_;
+};
 
-  return wait(pid);
+inline proc_stat parse_stat(const std::string_view line) {
+  // comm may contain anything including ')', so it ends at the last one.
+  const auto open = line.find('(');
+  const auto close = line.rfind(')');
+  if (open == line.npos || close == line.npos || close < open) [[unlikely]]
+    throw std::runtime_error {"invalid /proc/<pid>/stat format: " + std::string{line}};
+
+  proc_stat st {};
+  st.comm = line.substr(open + 1, close - open - 1);
+
+  field_scanner scan {line.substr(close + 1)};
+  st.state = scan.next().front();           // 3
+  st.ppid = scan.next<pid_t>();             // 4
+  scan.skip(9);                             // 5 - 13
+  st.utime = scan.next<uint64_t>();         // 14
+  scan.skip(7);                             // 15 - 21
+  st.starttime = scan.next<uint64_t>();     // 22
+  scan.skip(1);                             // 23
+  st.rss = scan.next<int64_t>();            // 24
+  return st;
 }
 
+// Reads the whole of `name` relative to `dirfd` into `buf`, reusing its
+// capacity. Returns false if it's gone, e.g. the process exited.
+inline bool read_at(const int dirfd, const char *name, std::string &buf) {
+  const auto fd = ::openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    if (errno == ENOENT || errno == ESRCH) return false;
+    throw std::system_error {errno, std::system_category(),
+      "failed to open " + std::string{name}};
+  }
+  const filesystem::unique_fd guard {fd};
+
+  buf.resize(std::max<size_t>(buf.capacity(), 4096));
+  size_t len = 0;
+  for (;;) {
+    if (len == buf.size()) buf.resize(2 * buf.size());
+    const auto n = ::read(fd, buf.data() + len, buf.size() - len);
+    if (n == 0) break;
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == ESRCH) return false;
+      throw std::system_error {errno, std::system_category(),
+        "failed to read " + std::string{name}};
+    }
+    len += static_cast<size_t>(n);
+  }
+  buf.resize(len);
+  return true;
+}
+
+} // namespace detail
+
 inline pid_t ppidof(const pid_t pid)
 {
   if (pid == getpid()) return ::getppid();
 
   std::string line;
-  if (!std::getline(std::ifstream {proc_dir / pid / "stat"}, line))
+  const auto path = (proc_dir / pid / "stat").string();
+  if (!detail::read_at(AT_FDCWD, path.c_str(), line))
     [[unlikely]] throw std::runtime_error {"failed to load /proc/<pid>/stat"};
 
-  char state;
-  pid_t ppid = {};
-  // man proc_pid_stat
-  const auto pos = line.find_last_of(')');
-  if (pos == std::string::npos) [[unlikely]] throw std::runtime_error {
-    "invalid /proc/" + std::to_string(pid) + "/stat format: closing parenthesis not found"};
-
-  std::istringstream {line.substr(pos + 1)} >> state >> ppid;
-  return ppid;
+  return detail::parse_stat(line).ppid;
 }
 
+/// Every process on the host at the time of `refresh()`, as a table of
+/// columns in pid order. `/proc` is walked through a directory fd held
+/// open and files are read into buffers kept across refreshes. A process
+/// seen on the previous refresh keeps its command line instead of reading
+/// it again.
+class ProcSnapshot {
+ public:
+  explicit ProcSnapshot(const path_t &proc = proc_dir) :
+    dirfd_(open_dir(proc)),
+    page_siz_(static_cast<size_t>(::sysconf(_SC_PAGESIZE)))
+  {
+    refresh();
+  }
+
+  void refresh() {
+    if (::lseek(dirfd_, 0, SEEK_SET) == -1) [[unlikely]]
+      throw std::system_error {errno, std::system_category(), "lseek /proc"};
+
+    scan_pids_.clear();
+    filesystem::detail::for_each_dirent(dirfd_, dents_, [this] (const struct dirent64 &d) {
+        pid_t pid = 0;
+        const auto name = std::string_view {d.d_name};
+        const auto [p, ec] = std::from_chars(name.data(), name.data() + name.size(), pid);
+        if (ec == std::errc {} && p == name.data() + name.size()) scan_pids_.push_back(pid);
+      });
+    std::sort(scan_pids_.begin(), scan_pids_.end());
+
+    columns next;
+    next.reserve(scan_pids_.size());
+    next.comms.reserve(cur_.comms.size());
+    next.cmdlines.reserve(cur_.cmdlines.size());
+
+    size_t prev = 0;
+    for (const auto pid : scan_pids_) {
+      char name[32];
+      const auto end = std::to_chars(name, name + sizeof(name), pid).ptr;
+
+      std::memcpy(end, "/stat", sizeof("/stat"));
+      if (!detail::read_at(dirfd_, name, buf_)) continue;
+      const auto st = detail::parse_stat(buf_);
+      // `st.comm` refers to `buf_`, which is reused for cmdline below.
+      // Kernel threads may have names longer than TASK_COMM_LEN.
+      const auto comm_off = next.comms.size();
+      next.comms.append(st.comm);
+      const auto comm_len = next.comms.size() - comm_off;
+
+      while (prev < cur_.pids.size() && cur_.pids[prev] < pid) ++prev;
+      const bool known = prev < cur_.pids.size() && cur_.pids[prev] == pid
+        && cur_.starttimes[prev] == st.starttime
+        && cur_.comm(prev) == std::string_view {next.comms}.substr(comm_off);
+
+      const auto off = next.cmdlines.size();
+      if (known) {
+        next.cmdlines.append(cur_.cmdline(prev));
+      } else {
+        std::memcpy(end, "/cmdline", sizeof("/cmdline"));
+        if (!detail::read_at(dirfd_, name, buf_)) {
+          next.comms.resize(comm_off);
+          continue;
+        }
+        next.cmdlines.append(buf_);
+      }
+      next.comm_offs.emplace_back(comm_off, comm_len);
+      next.cmdline_offs.emplace_back(off, next.cmdlines.size() - off);
+
+      next.pids.push_back(pid);
+      next.ppids.push_back(st.ppid);
+      next.states.push_back(st.state);
+      next.rss.push_back(static_cast<size_t>(std::max<int64_t>(st.rss, 0)) * page_siz_);
+      next.utimes.push_back(st.utime);
+      next.starttimes.push_back(st.starttime);
+    }
+    cur_ = std::move(next);
+  }
+
+  inline size_t size() const { return cur_.pids.size(); }
+  inline bool empty() const { return cur_.pids.empty(); }
+
+  inline std::span<const pid_t> pids() const { return cur_.pids; }
+  inline std::span<const pid_t> ppids() const { return cur_.ppids; }
+  inline std::span<const char> states() const { return cur_.states; }
+  /// Resident set size in bytes
+  inline std::span<const size_t> rss() const { return cur_.rss; }
+  /// User time in clock ticks, see sysconf(_SC_CLK_TCK)
+  inline std::span<const uint64_t> utimes() const { return cur_.utimes; }
+  inline std::string_view comm(const size_t i) const { return cur_.comm(i); }
+  /// Arguments separated by NUL, empty for kernel threads
+  inline std::string_view cmdline(const size_t i) const { return cur_.cmdline(i); }
+
+  /// Row of `pid` if it's in the table
+  inline std::optional<size_t> find(const pid_t pid) const {
+    const auto it = std::lower_bound(cur_.pids.begin(), cur_.pids.end(), pid);
+    if (it == cur_.pids.end() || *it != pid) return std::nullopt;
+    return static_cast<size_t>(it - cur_.pids.begin());
+  }
+
+ private:
+  struct columns {
+    std::vector<pid_t> pids;
+    std::vector<pid_t> ppids;
+    std::vector<char> states;
+    std::vector<size_t> rss;
+    std::vector<uint64_t> utimes;
+    std::vector<uint64_t> starttimes;
+    std::vector<std::pair<size_t, size_t>> comm_offs;
+    std::vector<std::pair<size_t, size_t>> cmdline_offs;
+    std::string comms;
+    std::string cmdlines;
+
+    void reserve(const size_t n) {
+      pids.reserve(n);
+      ppids.reserve(n);
+      states.reserve(n);
+      rss.reserve(n);
+      utimes.reserve(n);
+      starttimes.reserve(n);
+      comm_offs.reserve(n);
+      cmdline_offs.reserve(n);
+    }
+    inline std::string_view comm(const size_t i) const {
+      return std::string_view {comms}.substr(comm_offs[i].first, comm_offs[i].second);
+    }
+    inline std::string_view cmdline(const size_t i) const {
+      return std::string_view {cmdlines}.substr(cmdline_offs[i].first, cmdline_offs[i].second);
+    }
+  };
+
+  static filesystem::unique_fd open_dir(const path_t &p) {
+    const auto fd = ::open(p.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) [[unlikely]] throw std::system_error {
+      errno, std::system_category(), "failed to open " + p.string()};
+    return {fd};
+  }
+
+  filesystem::unique_fd dirfd_;
+  const size_t page_siz_;
+  std::vector<std::byte> dents_ = std::vector<std::byte>(32 * 1024);
+  std::vector<pid_t> scan_pids_;
+  std::string buf_;
+  columns cur_;
+};
+
 } // namespace gh4ck3r::process
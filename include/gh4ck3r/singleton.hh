@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <sstream>
@@ -24,15 +25,34 @@ template <typename T,
 class SharedSingleton : public std::shared_ptr<T> {
   using shared_ptr = std::shared_ptr<T>;
 
+#if __cpp_lib_atomic_shared_ptr
+  static inline std::atomic<typename shared_ptr::weak_type> weak_instance;
+#else
   static inline typename shared_ptr::weak_type weak_instance;
+#endif
+
   static inline auto get_instance() {
+#if __cpp_lib_atomic_shared_ptr
+    // fast path: instance is alive, no need to serialize on the mutex
+    if (auto sp = weak_instance.load(std::memory_order_acquire).lock(); sp) [[likely]] {
+      return sp;
+    }
+#endif
     static std::mutex m;
     std::lock_guard lk{m};
+#if __cpp_lib_atomic_shared_ptr
+    auto sp = weak_instance.load(std::memory_order_relaxed).lock();
+#else
     auto sp = weak_instance.lock();
+#endif
     if (!sp) {
       if (T* p = create_instance(); p) {
         sp.reset(p, destroy_instance);
+#if __cpp_lib_atomic_shared_ptr
+        weak_instance.store(sp, std::memory_order_release);
+#else
         weak_instance = sp;
+#endif
       } else {
         std::ostringstream oss;
         oss << "failed to create SharedSingleton instance";
@@ -52,7 +72,11 @@ class SharedSingleton : public std::shared_ptr<T> {
   SharedSingleton() : shared_ptr(get_instance()) {}
   inline operator auto() const { return shared_ptr::get(); }
 
+#if __cpp_lib_atomic_shared_ptr
+  static inline auto use_count() { return weak_instance.load().use_count(); }
+#else
   static inline auto use_count() { return weak_instance.use_count(); }
+#endif
 };
 
 class SingletonTraits {
@@ -1,33 +1,172 @@
 #pragma once
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <ranges>
 #include <string_view>
+#include <type_traits>
 #include <vector>
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 namespace gh4ck3r {
 
+/// Set of separators for `split_view`, e.g. `split_view<any_of<',', ';'>>`.
+template <char...CS>
+struct sepset {
+  static constexpr bool contains(const char c) { return ((c == CS) || ...); }
+};
+
+template <char...CS>
+inline constexpr sepset<CS...> any_of {};
+
+namespace detail::split {
+
+template <auto SEP>
+struct sep_traits { using type = std::remove_cvref_t<decltype(SEP)>; };
+
+template <char SEP>
+struct sep_traits<SEP> { using type = sepset<SEP>; };
+
+// Finds the first of `CS` in `[p, p + len)`, `len` if not found. NUL in `CS`
+// never matches so that `split<0x00>` keeps the whole string.
+template <char...CS>
+inline size_t find_first_of(const char * const p, const size_t len) {
+  if constexpr (((CS == 0x00) && ...)) {
+    return len;
+  } else {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= len; i += 32) {
+      const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+      __m256i m = _mm256_setzero_si256();
+      ((m = CS ? _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(CS))) : m), ...);
+      if (const auto bits = static_cast<uint32_t>(_mm256_movemask_epi8(m)); bits)
+        return i + static_cast<size_t>(std::countr_zero(bits));
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= len; i += 16) {
+      const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+      __m128i m = _mm_setzero_si128();
+      ((m = CS ? _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(CS))) : m), ...);
+      if (const auto bits = static_cast<uint32_t>(_mm_movemask_epi8(m)); bits)
+        return i + static_cast<size_t>(std::countr_zero(bits));
+    }
+#else
+    // SWAR: a byte of `x ^ broadcast(c)` is zero where `c` matches.
+    constexpr uint64_t lo = 0x0101010101010101ull, hi = 0x8080808080808080ull;
+    for (; i + 8 <= len; i += 8) {
+      uint64_t x;
+      std::memcpy(&x, p + i, sizeof(x));
+      uint64_t m = 0;
+      ((m |= CS ? ((x ^ (lo * static_cast<uint8_t>(CS))) - lo)
+                  & ~(x ^ (lo * static_cast<uint8_t>(CS))) & hi : 0), ...);
+      if (m) {
+        // A borrow may flag bytes above a real match; take the first real one.
+        for (auto j = i; j < i + 8; ++j)
+          if (((p[j] == CS && CS) || ...)) return j;
+      }
+    }
+#endif
+    for (; i < len; ++i)
+      if (((p[i] == CS && CS) || ...)) return i;
+    return len;
+  }
+}
+
+template <typename SEPS, char ESC>
+struct scanner;
+
+template <char...SEPS, char ESC>
+struct scanner<sepset<SEPS...>, ESC> {
+  static_assert(!ESC || !sepset<SEPS...>::contains(ESC));
+
+  // Length of the first token, i.e. position of the first unescaped
+  // separator. ESC escapes the following character, so a separator preceded
+  // by an odd run of ESC doesn't split.
+  static size_t token_length(const std::string_view str) {
+    size_t pos = 0;
+    while (pos < str.size()) {
+      const auto i = pos + find_first_of<SEPS..., ESC>(str.data() + pos, str.size() - pos);
+      if (!ESC || i == str.size() || str[i] != ESC) return i;
+      pos = i + 2;
+    }
+    return str.size();
+  }
+};
+
+} // namespace detail::split
+
+/// Lazy, allocation free counterpart of `split()`. Tokens are `string_view`s
+/// into the given string and escape characters are kept as they are.
+template <auto SEP, char ESC = 0x00>
+class split_view : public std::ranges::view_interface<split_view<SEP, ESC>> {
+  using scanner = detail::split::scanner<
+    typename detail::split::sep_traits<SEP>::type, ESC>;
+
+ public:
+  class iterator {
+   public:
+    using value_type = std::string_view;
+    using difference_type = std::ptrdiff_t;
+    using iterator_category = std::forward_iterator_tag;
+
+    iterator() = default;
+    explicit iterator(const std::string_view str) :
+      rest_(str), len_(scanner::token_length(str)), done_(false)
+    {}
+
+    inline value_type operator*() const { return rest_.substr(0, len_); }
+
+    iterator &operator++() {
+      if (len_ == rest_.size()) {
+        done_ = true;
+      } else {
+        rest_.remove_prefix(len_ + 1);
+        len_ = scanner::token_length(rest_);
+      }
+      return *this;
+    }
+
+    inline iterator operator++(int) {
+      auto it = *this;
+      ++*this;
+      return it;
+    }
+
+    inline bool operator==(const iterator &rhs) const {
+      return done_ == rhs.done_ && (done_ || rest_.data() == rhs.rest_.data());
+    }
+    inline bool operator==(std::default_sentinel_t) const { return done_; }
+
+   private:
+    std::string_view rest_ {};
+    size_t len_ {0};
+    bool done_ {true};
+  };
+
+  split_view() = default;
+  explicit split_view(const std::string_view str) : str_(str) {}
+
+  inline iterator begin() const { return iterator {str_}; }
+  inline std::default_sentinel_t end() const { return {}; }
+
+ private:
+  std::string_view str_ {};
+};
+
 template <char SEP, char ESC = 0x00>
 auto split(const std::string_view str)
 {
   static_assert(!SEP || SEP != ESC);
 
   std::vector<std::string_view> ret {};
-
-  constexpr auto npos = std::string_view::npos;
-  size_t beg = 0, end = 0;
-  do {
-    end = str.find_first_of(SEP, beg);
-    if constexpr (ESC) {
-      if (auto i = end; i && i != npos && str[--i] == ESC) [[likely]] {
-        bool escaped = true;
-        while (i-->0 && str[i] == ESC) escaped ^= true;
-        if (escaped) end = str.find_first_of(SEP, end + 1);
-      }
-    }
-    ret.emplace_back(str.substr(beg, end == npos ? npos : end - beg));
-    beg = end + 1;
-  } while (end != npos);
-
+  for (const auto token : split_view<SEP, ESC> {str}) ret.emplace_back(token);
   return ret;
 }
 
-
 } // namespace gh4ck3r
@@ -64,3 +64,147 @@ TEST(base64, decode_as)
   std::vector<uint8_t> v{begin(s), end(s)};
   EXPECT_EQ(v, base64::decode_as<decltype(v)>("aGVsbG8gd29ybGQ="sv));
 }
+
+TEST(base64, decode_invalid)
+{
+  EXPECT_THROW(base64::decode("aGVs*G8gd29ybGQ="sv), std::invalid_argument);
+  EXPECT_THROW(base64::decode("aGVsbG8gd29ybGQ\x80"sv), std::invalid_argument);
+}
+
+TEST(base64, encoded_size)
+{
+  EXPECT_EQ(0, base64::encoded_size(0));
+  EXPECT_EQ(4, base64::encoded_size(1));
+  EXPECT_EQ(4, base64::encoded_size(3));
+  EXPECT_EQ(8, base64::encoded_size(4));
+}
+
+TEST(base64, decoded_size)
+{
+  EXPECT_EQ(0, base64::decoded_size(""sv));
+  EXPECT_EQ(11, base64::decoded_size("aGVsbG8gd29ybGQ="sv));
+  EXPECT_EQ(11, base64::decoded_size("aGVsbG8gd29ybGQ"sv));
+  EXPECT_EQ(10, base64::decoded_size("aGVsbG8gd29ybA=="sv));
+}
+
+TEST(base64, encode_to)
+{
+  constexpr auto s {"hello world"sv};
+  std::string out(base64::encoded_size(s.size()), 0x00);
+  EXPECT_EQ(out.size(), base64::encode_to(s.data(), s.size(), out.data()));
+  EXPECT_EQ("aGVsbG8gd29ybGQ="sv, out);
+}
+
+TEST(base64, kernels)
+{
+  namespace detail = base64::detail;
+  std::vector<detail::kernel> kernels {
+    {"scalar", detail::scalar::encode, detail::scalar::decode}};
+#ifdef GH4CK3R_BASE64_SIMD
+  if (__builtin_cpu_supports("ssse3"))
+    kernels.push_back({"ssse3", detail::ssse3::encode, detail::ssse3::decode});
+  if (__builtin_cpu_supports("avx2"))
+    kernels.push_back({"avx2", detail::avx2::encode, detail::avx2::decode});
+  if (__builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("avx512bw"))
+    kernels.push_back({"avx512vbmi", detail::avx512vbmi::encode, detail::avx512vbmi::decode});
+#endif
+
+  std::vector<uint8_t> data(1024);
+  for (size_t i = 0; i < data.size(); ++i) data[i] = static_cast<uint8_t>(i * 7 + i / 256);
+
+  for (size_t len = 0; len <= 300; ++len) {
+    std::string expected(base64::encoded_size(len), 0x00);
+    detail::scalar::encode(data.data(), len, expected.data());
+
+    for (const auto &k : kernels) {
+      std::string encoded(expected.size(), 0x00);
+      ASSERT_EQ(expected.size(), k.encode(data.data(), len, encoded.data())) << k.name;
+      ASSERT_EQ(expected, encoded) << k.name << ": " << len;
+
+      std::vector<uint8_t> decoded(base64::decoded_size(encoded));
+      ASSERT_EQ(len, k.decode(encoded.data(), encoded.size(), decoded.data())) << k.name;
+      ASSERT_TRUE(std::equal(decoded.begin(), decoded.end(), data.begin())) << k.name << ": " << len;
+
+      // invalid character in the middle of SIMD block
+      if (len > 30) {
+        auto invalid {encoded};
+        invalid[len / 2] = '*';
+        ASSERT_EQ(base64::npos, k.decode(invalid.data(), invalid.size(), decoded.data())) << k.name;
+      }
+    }
+  }
+}
+
+TEST(base64, Encoder_span)
+{
+  const auto s {"hello world"s};
+  base64::Encoder enc;
+  std::string out;
+  for (size_t i = 0; i < s.size(); i += 2) {
+    const auto chunk = std::string_view{s}.substr(i, 2);
+    std::string buf(base64::Encoder::max_output(chunk.size()), 0x00);
+    buf.resize(enc.update(
+          {reinterpret_cast<const uint8_t *>(chunk.data()), chunk.size()}, buf));
+    out += buf;
+  }
+  std::string buf(4, 0x00);
+  buf.resize(enc.finalize(buf));
+  out += buf;
+
+  EXPECT_EQ("aGVsbG8gd29ybGQ="s, out);
+}
+
+TEST(base64, Encoder_sink)
+{
+  std::string data(100000, 0x00);
+  for (size_t i = 0; i < data.size(); ++i) data[i] = static_cast<char>(i * 13);
+
+  std::string out;
+  size_t ncalls = 0;
+  base64::Encoder enc {[&] (std::string_view s) { out += s; ++ncalls; }, 1024};
+  for (size_t i = 0; i < data.size(); i += 777)
+    enc.update(std::string_view{data}.substr(i, 777));
+  enc.finalize();
+
+  EXPECT_EQ(base64::encode(begin(data), end(data)), out);
+  EXPECT_LT(100, ncalls);
+}
+
+TEST(base64, Decoder_span)
+{
+  const auto b64 {"aGVsbG8gd29ybGQ="sv};
+  base64::Decoder dec;
+  std::vector<uint8_t> out;
+  for (size_t i = 0; i < b64.size(); i += 3) {
+    const auto chunk = b64.substr(i, 3);
+    std::vector<uint8_t> buf(base64::Decoder::max_output(chunk.size()));
+    buf.resize(dec.update(chunk, buf));
+    out.insert(out.end(), buf.begin(), buf.end());
+  }
+  std::vector<uint8_t> buf(2);
+  buf.resize(dec.finalize(buf));
+  out.insert(out.end(), buf.begin(), buf.end());
+
+  EXPECT_EQ("hello world"s, std::string(out.begin(), out.end()));
+}
+
+TEST(base64, Decoder_sink)
+{
+  std::string data(100000, 0x00);
+  for (size_t i = 0; i < data.size(); ++i) data[i] = static_cast<char>(i * 13);
+  const auto b64 = base64::encode(begin(data), end(data));
+
+  std::string out;
+  base64::Decoder dec {[&] (std::span<const uint8_t> s) { out.append(s.begin(), s.end()); }, 1024};
+  for (size_t i = 0; i < b64.size(); i += 1001)
+    dec.update(std::string_view{b64}.substr(i, 1001));
+  dec.finalize();
+
+  EXPECT_EQ(data, out);
+}
+
+TEST(base64, Decoder_invalid)
+{
+  base64::Decoder dec {[] (std::span<const uint8_t>) {}};
+  EXPECT_THROW(dec.update("aGVs*G8g"sv), std::invalid_argument);
+}
@@ -1,5 +1,14 @@
 #include <gh4ck3r/crypto.hh>
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <csignal>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
 
 using Alg = gh4ck3r::crypto::Alg;
 using Mode = gh4ck3r::crypto::Mode;
@@ -83,3 +92,340 @@ TEST_F(OpenSSL3Test, SEED_CBC)
     .finalize()));
 }
 #endif
+
+namespace {
+
+std::vector<uint8_t> unhex(const std::string_view hex) {
+  std::vector<uint8_t> ret;
+  for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+    ret.push_back(static_cast<uint8_t>(std::stoi(std::string {hex.substr(i, 2)}, nullptr, 16)));
+  }
+  return ret;
+}
+
+template <size_t N>
+std::array<uint8_t, N> unhex_array(const std::string_view hex) {
+  std::array<uint8_t, N> ret;
+  const auto v = unhex(hex);
+  std::copy_n(v.begin(), N, ret.begin());
+  return ret;
+}
+
+std::vector<uint8_t> make_data(const size_t len) {
+  std::vector<uint8_t> data(len);
+  for (size_t i = 0; i < len; ++i) data[i] = static_cast<uint8_t>(i * 131 + i / 251);
+  return data;
+}
+
+// NIST SP 800-38A F.2.1, F.5.1
+const auto aes128_key = unhex_array<16>("2b7e151628aed2a6abf7158809cf4f3c");
+const auto sp800_38a_plaintext = unhex(
+    "6bc1bee22e409f96e93d7e117393172a" "ae2d8a571e03ac9c9eb76fac45af8e51"
+    "30c81c46a35ce411e5fbc1191a0a52ef" "f69f2445df4f9b17ad2b417be66c3710");
+
+} // namespace
+
+using gh4ck3r::crypto::Encryptor;
+using gh4ck3r::crypto::Decryptor;
+
+TEST(crypto, AES_128_CBC)
+{
+  const auto iv = unhex_array<16>("000102030405060708090a0b0c0d0e0f");
+  const auto expected = unhex(
+      "7649abac8119b246cee98e9b12e9197d" "5086cb9b507219ee95db113a917678b2"
+      "73bed6b8e3c1743b7116e69e22229516" "3ff1caa1681fac09120eca307586e1a7");
+
+  const auto ciphertext = Encryptor<Alg::AES_128, Mode::CBC> {aes128_key, iv}
+    .update(sp800_38a_plaintext.data(), sp800_38a_plaintext.size())
+    .finalize();
+  // followed by a block of padding
+  ASSERT_EQ(expected.size() + 16, ciphertext.size());
+  EXPECT_TRUE(std::equal(expected.begin(), expected.end(), ciphertext.begin()));
+
+  EXPECT_EQ(sp800_38a_plaintext, (Decryptor<Alg::AES_128, Mode::CBC> {aes128_key, iv}
+    .update(ciphertext.data(), ciphertext.size())
+    .finalize()));
+}
+
+TEST(crypto, AES_128_CTR)
+{
+  const auto iv = unhex_array<16>("f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff");
+  const auto expected = unhex(
+      "874d6191b620e3261bef6864990db6ce" "9806f66b7970fdff8617187bb9fffdff"
+      "5ae4df3edbd5d35e5b4f09020db03eab" "1e031dda2fbe03d1792170a0f3009cee");
+
+  EXPECT_EQ(expected, (Encryptor<Alg::AES_128, Mode::CTR> {aes128_key, iv}
+    .update(sp800_38a_plaintext.data(), sp800_38a_plaintext.size())
+    .finalize()));
+}
+
+TEST(crypto, AES_256_GCM)
+{
+  const std::array<uint8_t, 32> key {1, 2, 3};
+  const std::array<uint8_t, 12> iv {4, 5, 6};
+  const auto plaintext = make_data(1000);
+
+  Encryptor<Alg::AES_256, Mode::GCM> enc {key, iv};
+  const auto ciphertext = enc.update(plaintext.data(), plaintext.size()).finalize();
+  const auto tag = enc.tag();
+  EXPECT_EQ(plaintext.size(), ciphertext.size());
+
+  EXPECT_EQ(plaintext, (Decryptor<Alg::AES_256, Mode::GCM> {key, iv}
+    .update(ciphertext.data(), ciphertext.size())
+    .tag(tag)
+    .finalize()));
+
+  auto forged = tag;
+  forged[0] ^= 1;
+  Decryptor<Alg::AES_256, Mode::GCM> dec {key, iv};
+  dec.update(ciphertext.data(), ciphertext.size()).tag(forged);
+  EXPECT_THROW(dec.finalize(), gh4ck3r::crypto::ERR);
+}
+
+TEST(crypto, decrypt_parallel_CBC)
+{
+  const std::array<uint8_t, 16> key {0xde, 0xad}, iv {0xbe, 0xef};
+  const auto plaintext = make_data(1024 * 1024 + 5);
+  const auto ciphertext = Encryptor<Alg::AES_128, Mode::CBC> {key, iv}
+    .update(plaintext.data(), plaintext.size())
+    .finalize();
+
+  for (const unsigned nthreads : {1u, 3u, 4u}) {
+    std::vector<uint8_t> out(ciphertext.size());
+    out.resize(gh4ck3r::crypto::decrypt_parallel<Alg::AES_128, Mode::CBC>(
+          key, iv, ciphertext, out, nthreads));
+    EXPECT_EQ(plaintext, out) << nthreads;
+  }
+
+  // in place
+  auto buf = ciphertext;
+  buf.resize(gh4ck3r::crypto::decrypt_parallel<Alg::AES_128, Mode::CBC>(
+        key, iv, buf, buf, 4));
+  EXPECT_EQ(plaintext, buf);
+
+  EXPECT_THROW((gh4ck3r::crypto::decrypt_parallel<Alg::AES_128, Mode::CBC>(
+          key, iv, std::span {ciphertext}.first(100), buf)), std::invalid_argument);
+}
+
+TEST(crypto, encrypt_parallel_CTR)
+{
+  const std::array<uint8_t, 16> key {0xde, 0xad};
+  // counter carries over the lower 64 bits
+  const auto iv = unhex_array<16>("0001020304050607fffffffffffffff0");
+  const auto plaintext = make_data(1024 * 1024 + 5);
+  const auto expected = Encryptor<Alg::AES_128, Mode::CTR> {key, iv}
+    .update(plaintext.data(), plaintext.size())
+    .finalize();
+
+  std::vector<uint8_t> out(plaintext.size());
+  EXPECT_EQ(out.size(), (gh4ck3r::crypto::encrypt_parallel<Alg::AES_128, Mode::CTR>(
+          key, iv, plaintext, out, 4)));
+  EXPECT_EQ(expected, out);
+
+  EXPECT_EQ(out.size(), (gh4ck3r::crypto::decrypt_parallel<Alg::AES_128, Mode::CTR>(
+          key, iv, out, out, 4)));
+  EXPECT_EQ(plaintext, out);
+}
+
+TEST(crypto, update_span)
+{
+  using Enc = Encryptor<Alg::AES_128, Mode::CBC>;
+  using Dec = Decryptor<Alg::AES_128, Mode::CBC>;
+  static_assert(Enc::max_output(100) == 116);
+  static_assert(Encryptor<Alg::AES_128, Mode::CTR>::max_output(100) == 100);
+
+  const auto plaintext = make_data(1000);
+  const auto expected = Enc {aes128_key}.update(plaintext.data(), plaintext.size()).finalize();
+
+  std::array<uint8_t, 2048> buf;
+  Enc enc {aes128_key};
+  size_t n = 0;
+  for (size_t off = 0; off < plaintext.size(); off += 77) {
+    const auto chunk = std::span {plaintext}.subspan(off, std::min<size_t>(77, plaintext.size() - off));
+    n += enc.update(chunk, std::span {buf}.subspan(n));
+  }
+  n += enc.finalize(std::span {buf}.subspan(n));
+  EXPECT_EQ(expected, std::vector<uint8_t>(buf.begin(), buf.begin() + n));
+
+  // in place
+  Dec dec {aes128_key};
+  auto m = dec.update(std::span {buf}.first(n), buf);
+  m += dec.finalize(std::span {buf}.subspan(m));
+  EXPECT_EQ(plaintext, std::vector<uint8_t>(buf.begin(), buf.begin() + m));
+
+  EXPECT_THROW(Enc {}.update(plaintext, std::span {buf}.first(plaintext.size())), std::invalid_argument);
+  EXPECT_THROW(Enc {}.finalize(std::span {buf}.first(1)), std::invalid_argument);
+}
+
+TEST(crypto, update_in_place_CTR)
+{
+  const std::array<uint8_t, 16> key {1}, iv {2};
+  const auto plaintext = make_data(1001);
+  const auto expected = Encryptor<Alg::AES_128, Mode::CTR> {key, iv}
+    .update(plaintext.data(), plaintext.size())
+    .finalize();
+
+  auto buf = plaintext;
+  Encryptor<Alg::AES_128, Mode::CTR> enc {key, iv};
+  for (size_t off = 0; off < buf.size(); off += 13) {
+    const auto chunk = std::span {buf}.subspan(off, std::min<size_t>(13, buf.size() - off));
+    EXPECT_EQ(chunk.size(), enc.update(chunk, chunk));
+  }
+  EXPECT_EQ(0u, enc.finalize({}));
+  EXPECT_EQ(expected, buf);
+}
+
+TEST(crypto, update_in_place_CBC)
+{
+  using Enc = Encryptor<Alg::AES_128, Mode::CBC>;
+  using Dec = Decryptor<Alg::AES_128, Mode::CBC>;
+  const std::array<uint8_t, 16> key {1}, iv {2};
+  const auto plaintext = make_data(160);
+  const auto expected = Enc {key, iv}.update(plaintext.data(), plaintext.size()).finalize();
+
+  // room for a block past the input, of plaintext and of ciphertext
+  auto buf = plaintext;
+  buf.resize(Dec::max_output(Enc::max_output(plaintext.size())));
+  const auto in = std::span {buf}.first(plaintext.size());
+
+  Enc enc {key, iv};
+  auto n = enc.update(in, buf);
+  n += enc.finalize(std::span {buf}.subspan(n));
+  EXPECT_EQ(expected, std::vector<uint8_t>(buf.begin(), buf.begin() + n));
+
+  // without the room
+  EXPECT_THROW((Enc {key, iv}.update(in, in)), std::invalid_argument);
+
+  Dec dec {key, iv};
+  auto m = dec.update(std::span {buf}.first(n), buf);
+  m += dec.finalize(std::span {buf}.subspan(m));
+  EXPECT_EQ(plaintext, std::vector<uint8_t>(buf.begin(), buf.begin() + m));
+}
+
+TEST(crypto, reset)
+{
+  const std::array<uint8_t, 16> key1 {1}, key2 {2}, iv {3};
+  const auto plaintext = make_data(100);
+  const auto expected = Encryptor<Alg::AES_128, Mode::CBC> {key2, iv}
+    .update(plaintext.data(), plaintext.size())
+    .finalize();
+
+  Encryptor<Alg::AES_128, Mode::CBC> enc {key1};
+  // leaves partial block behind
+  enc.update(plaintext.data(), 7);
+  EXPECT_EQ(expected, enc.reset(key2, iv).update(plaintext.data(), plaintext.size()).finalize());
+  EXPECT_EQ(expected, enc.reset(key2, iv).update(plaintext.data(), plaintext.size()).finalize());
+}
+
+TEST(crypto, pooled_contexts)
+{
+  const std::array<uint8_t, 16> key {1}, iv {3};
+  const auto plaintext = make_data(100);
+  const auto expected = Encryptor<Alg::AES_128, Mode::CBC> {key, iv}
+    .update(plaintext.data(), plaintext.size())
+    .finalize();
+
+  // contexts going back and forth to the pool, more of them than it keeps
+  for (int round = 0; round < 3; ++round) {
+    std::vector<std::unique_ptr<Encryptor<Alg::AES_128, Mode::CBC>>> encs;
+    for (int i = 0; i < 10; ++i) {
+      encs.emplace_back(std::make_unique<Encryptor<Alg::AES_128, Mode::CBC>>(key, iv));
+      encs.back()->update(plaintext.data(), static_cast<size_t>(i));
+    }
+    for (auto &enc : encs) {
+      EXPECT_EQ(expected, enc->reset(key, iv).update(plaintext.data(), plaintext.size()).finalize());
+    }
+  }
+
+  // pooled SEED context along with the legacy provider
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_EQ(plaintext, (Decryptor<Alg::SEED, Mode::CBC> {}
+      .update(Encryptor<Alg::SEED, Mode::CBC> {}
+        .update(plaintext.data(), plaintext.size())
+        .finalize().data(), 112)
+      .finalize()));
+  }
+}
+
+TEST(crypto, outlives_pool)
+{
+  // constructed ahead of the context pool of the thread, so destroyed after it
+  std::thread {[] {
+    thread_local std::unique_ptr<Encryptor<Alg::AES_128, Mode::CBC>> enc;
+    enc = std::make_unique<Encryptor<Alg::AES_128, Mode::CBC>>();
+    enc->update(make_data(16).data(), 16);
+  }}.join();
+}
+
+TEST(crypto, crypt_stream)
+{
+  namespace fs = gh4ck3r::filesystem;
+  using gh4ck3r::crypto::crypt_stream;
+
+  const std::array<uint8_t, 16> key {1}, iv {2};
+  const auto plaintext = make_data(5 * 1024 * 1024 + 3);
+  const auto expected = Encryptor<Alg::AES_128, Mode::CBC> {key, iv}
+    .update(plaintext.data(), plaintext.size())
+    .finalize();
+
+  fs::FileWriter<fs::TempFile> src;
+  ASSERT_TRUE(src.write(plaintext));
+  ASSERT_EQ(0, lseek(src.fd(), 0, SEEK_SET));
+
+  // fd to FileWriter
+  fs::FileWriter<fs::TempFile> encrypted;
+  {
+    Encryptor<Alg::AES_128, Mode::CBC> enc {key, iv};
+    EXPECT_EQ(expected.size(), crypt_stream(enc, src.fd(), encrypted, 1024 * 1024));
+    EXPECT_EQ(expected, fs::load_file(encrypted.path()));
+  }
+
+  // mapped_file to fd
+  fs::FileWriter<fs::TempFile> decrypted;
+  {
+    Decryptor<Alg::AES_128, Mode::CBC> dec {key, iv};
+    const fs::mapped_file mapped {encrypted.path()};
+    const auto fd = decrypted.fd();
+    EXPECT_EQ(plaintext.size(), crypt_stream(dec, mapped, fd, 100000));
+    EXPECT_EQ(plaintext, fs::load_file(decrypted.path()));
+  }
+}
+
+TEST(crypto, crypt_stream_error)
+{
+  using gh4ck3r::crypto::crypt_stream;
+  const auto plaintext = make_data(1000);
+
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  close(fds[0]);
+  const auto sigpipe = signal(SIGPIPE, SIG_IGN);
+  {
+    Encryptor<Alg::AES_128, Mode::CTR> enc;
+    EXPECT_THROW(crypt_stream(enc, std::span {plaintext}, fds[1], 100), std::system_error);
+  }
+  signal(SIGPIPE, sigpipe);
+  close(fds[1]);
+
+  // a failing writer wakes up the reader waiting for more from a pipe
+  struct failing_writer {
+    bool write(const uint8_t*, size_t) { errno = EIO; return false; }
+  } writer;
+  ASSERT_EQ(0, pipe(fds));
+  ASSERT_EQ(100, write(fds[1], plaintext.data(), 100));
+  {
+    Encryptor<Alg::AES_128, Mode::CTR> enc;
+    EXPECT_THROW(crypt_stream(enc, fds[0], writer, 100), std::system_error);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  // truncated ciphertext
+  const auto ciphertext = Encryptor<Alg::AES_128, Mode::CBC> {}
+    .update(plaintext.data(), plaintext.size())
+    .finalize();
+  Decryptor<Alg::AES_128, Mode::CBC> dec;
+  const auto devnull = open("/dev/null", O_WRONLY);
+  EXPECT_THROW(crypt_stream(dec, std::span {ciphertext}.first(1000), devnull), gh4ck3r::crypto::ERR);
+  close(devnull);
+}
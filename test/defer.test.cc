@@ -1,7 +1,10 @@
 #include "gh4ck3r/defer.hh"
 #include <gtest/gtest.h>
+#include <array>
+#include <memory>
 
 using gh4ck3r::Defer;
+using gh4ck3r::InplaceDefer;
 
 TEST(defer, basic)
 {
@@ -17,7 +20,7 @@ TEST(defer, assign)
 {
   int v = 0;
   {
-    Defer _ {[&] {v = 1;}};
+    Defer<> _ {[&] {v = 1;}};
     _ = [&] {v = 2;};
     EXPECT_EQ(0, v);
   }
@@ -29,7 +32,7 @@ TEST(defer, assign_lvalue)
   int v = 0;
   {
     EXPECT_EQ(0, v);
-    Defer _ {[&] {v = 1;}};
+    Defer<> _ {[&] {v = 1;}};
     const auto func = [&] {v = 2;};
     _ = func;
     EXPECT_EQ(0, v);
@@ -58,3 +61,82 @@ TEST(defer, invoke)
   }
   EXPECT_EQ(1, v);
 }
+
+TEST(defer, deduced)
+{
+  int v = 0;
+  {
+    const auto fn = [&] {++v;};
+    Defer _ {fn};
+    static_assert(std::is_same_v<Defer<std::remove_const_t<decltype(fn)>>, decltype(_)>);
+    static_assert(sizeof(_) <= sizeof(fn) + sizeof(void*));
+  }
+  EXPECT_EQ(1, v);
+}
+
+TEST(defer, move_only)
+{
+  int v = 0;
+  {
+    Defer _ {[&v, p = std::make_unique<int>(3)] {v = *p;}};
+  }
+  EXPECT_EQ(3, v);
+}
+
+TEST(defer, nothrow)
+{
+  bool called = false;
+  EXPECT_NO_THROW({
+      Defer _ {[&] {called = true; throw std::runtime_error {"ignored"};}};
+    });
+  EXPECT_TRUE(called);
+}
+
+TEST(InplaceDefer, basic)
+{
+  bool v = false;
+  {
+    InplaceDefer _ {[&] {v = true;}};
+    EXPECT_FALSE(v);
+  }
+  EXPECT_TRUE(v);
+}
+
+TEST(InplaceDefer, assign)
+{
+  int v = 0;
+  {
+    InplaceDefer<64> _ {[&] {v = 1;}};
+    const std::array<int, 8> arr {1, 2, 3, 4, 5, 6, 7, 8};
+    _ = [&v, arr] {v = arr[7];};
+    EXPECT_EQ(0, v);
+  }
+  EXPECT_EQ(8, v);
+}
+
+TEST(InplaceDefer, release)
+{
+  int v = 0;
+  auto p = std::make_shared<int>(1);
+  {
+    InplaceDefer _ {[&v, p] {v = *p;}};
+    EXPECT_EQ(2, p.use_count());
+    _.release();
+    EXPECT_EQ(1, p.use_count());
+  }
+  EXPECT_EQ(0, v);
+}
+
+TEST(InplaceDefer, invoke)
+{
+  int v = 0;
+  auto p = std::make_shared<int>(1);
+  {
+    InplaceDefer _ {[&v, p] {v += *p;}};
+    _();
+    EXPECT_EQ(1, v);
+    EXPECT_EQ(1, p.use_count());
+    EXPECT_THROW(_(), std::logic_error);
+  }
+  EXPECT_EQ(1, v);
+}
@@ -1,5 +1,9 @@
 #include "gh4ck3r/file.hh"
+#include <cctype>
 #include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
@@ -46,6 +50,19 @@ TEST(unique_fd, empty)
   EXPECT_THROW(unique_fd {-1}, std::invalid_argument);
 }
 
+TEST(unique_fd, move)
+{
+  const int fd = ::open(__FILE__, O_RDONLY);
+  ASSERT_NE(-1, fd);
+  {
+    unique_fd ufd1 { fd };
+    unique_fd ufd2 { std::move(ufd1) };
+    EXPECT_EQ(fd, ufd2);
+    EXPECT_TRUE(is_valid(fd));
+  }
+  EXPECT_FALSE(is_valid(fd));
+}
+
 TEST(create_tempfile, default)
 {
   const auto [fd, path] = create_tempfile();
@@ -113,6 +130,78 @@ TEST(load_file, invalid_argument)
   EXPECT_THROW(load_file("/dev/stdin"), std::invalid_argument);
 }
 
+TEST(load_file, pseudo_file)
+{
+  // /proc files are regular but report zero size
+  EXPECT_EQ(load_file<std::string>("/proc/self/comm"),
+            path_t{__FILE_NAME__}.stem().string() + '\n');
+}
+
+TEST(load_file, large)
+{
+  const auto [fd, path] = create_tempfile();
+
+  std::string content(3 * 4096 + 7, 0x00);
+  for (size_t i = 0; i < content.size(); ++i) content[i] = static_cast<char>(i);
+  std::ofstream {path} << content;
+
+  EXPECT_EQ(load_file<std::string>(path), content);
+  EXPECT_EQ(load_file<std::vector<char>>(path),
+            std::vector<char>(content.begin(), content.end()));
+
+  EXPECT_TRUE(remove(path));
+}
+
+TEST(mapped_file, default)
+{
+  const auto [fd, path] = create_tempfile();
+
+  constexpr std::string_view content {"0123456789"};
+  std::ofstream {path} << content;
+
+  const mapped_file m {path, {.populate = true, .sequential = true}};
+  ASSERT_EQ(m.size(), content.size());
+  EXPECT_TRUE(std::equal(m.begin(), m.end(), content.begin()));
+
+  const std::span<const uint8_t> s {m};
+  EXPECT_EQ(s.data(), m.data());
+  EXPECT_EQ(s.size(), content.size());
+
+  EXPECT_TRUE(remove(path));
+}
+
+TEST(mapped_file, unique_fd)
+{
+  const auto [fd, path] = create_tempfile();
+
+  constexpr std::string_view content {"Hello World!"};
+  ASSERT_EQ(content.size(), ::write(fd, content.data(), content.size()));
+  EXPECT_TRUE(remove(path));
+
+  const mapped_file m {unique_fd {fd}};
+  EXPECT_EQ(m.fd(), fd);
+  EXPECT_EQ(std::string_view(reinterpret_cast<const char *>(m.data()), m.size()),
+            content);
+}
+
+TEST(mapped_file, empty)
+{
+  const auto [fd, path] = create_tempfile();
+  {
+    const mapped_file m {unique_fd {fd}};
+    EXPECT_TRUE(m.empty());
+    EXPECT_EQ(m.begin(), m.end());
+  }
+  EXPECT_FALSE(is_valid(fd));
+  EXPECT_TRUE(remove(path));
+}
+
+TEST(mapped_file, invalid_argument)
+{
+  EXPECT_THROW(mapped_file {"/proc"}, std::invalid_argument);
+  EXPECT_THROW(mapped_file {"/dev/stdin"}, std::invalid_argument);
+}
+
 TEST(dir_siz, default)
 {
   const auto tempdir = read_symlink("/proc/self/cwd") / "";
@@ -170,6 +259,103 @@ TEST(FileWriter, default)
   EXPECT_EQ(s1, s2);
 }
 
+TEST(FileWriter, pipe_nonblock)
+{
+  int pipefd[2];
+  ASSERT_EQ(0, pipe2(pipefd, O_CLOEXEC | O_NONBLOCK));
+
+  struct PipeFile : FileTrait {
+    explicit PipeFile(fd_t fd) : fd_(fd) {}
+    const path_t &path() const override { throw std::logic_error {"pipe"}; }
+    fd_t fd() const override { return fd_; }
+    fd_t fd_;
+  };
+
+  // larger than the pipe capacity; write() has to wait for the reader
+  const std::string s1(1 << 20, 'x');
+  std::string s2;
+  std::thread reader {[&] {
+    char buf[4096];
+    for (ssize_t r; (r = ::read(pipefd[0], buf, sizeof(buf))) != 0;) {
+      if (r > 0) s2.append(buf, static_cast<size_t>(r));
+      else if (errno == EAGAIN) std::this_thread::yield();
+      else break;
+    }
+  }};
+
+  {
+    FileWriter<PipeFile> writer {pipefd[1]};
+    EXPECT_TRUE(writer.write(s1));
+    ASSERT_EQ(0, ::close(pipefd[1]));
+  }
+  reader.join();
+  ASSERT_EQ(0, ::close(pipefd[0]));
+
+  EXPECT_EQ(s1, s2);
+}
+
+TEST(BufferedFileWriter, default)
+{
+  // writes through FileWriter would bypass the buffer
+  static_assert(!std::is_convertible_v<BufferedFileWriter<TempFile>&, FileWriter<TempFile>&>);
+
+  path_t path;
+  std::string expected;
+  {
+    BufferedFileWriter<TempFile> writer {{.buf_siz = 16}};
+    path = writer.path();
+    EXPECT_FALSE(writer.uses_io_uring());
+
+    for (const auto s : {"hello", " ", "world"}) {
+      EXPECT_TRUE(writer.write(std::string_view{s}));
+      expected += s;
+    }
+    EXPECT_EQ(expected.size(), writer.buffered());
+    EXPECT_EQ(0, file_size(path));
+
+    // doesn't fit; goes out with the buffered data
+    const std::string large(100, 'x');
+    EXPECT_TRUE(writer.write(large));
+    expected += large;
+    EXPECT_EQ(0, writer.buffered());
+    EXPECT_EQ(expected.size(), file_size(path));
+
+    const std::string a {"abc"}, b {"def"};
+    const std::array iov {
+      iovec {const_cast<char *>(a.data()), a.size()},
+      iovec {const_cast<char *>(b.data()), b.size()},
+    };
+    EXPECT_TRUE(writer.writev(iov));
+    expected += a + b;
+
+    EXPECT_TRUE(writer.sync());
+    EXPECT_EQ(expected, load_file<std::string>(path));
+  }
+}
+
+TEST(BufferedFileWriter, io_uring)
+{
+  std::string expected;
+  {
+    BufferedFileWriter<TempFile> writer {{.buf_siz = 64, .use_io_uring = true}};
+    if (!writer.uses_io_uring()) GTEST_SKIP() << "io_uring is not available";
+
+    for (int i = 0; i < 1000; ++i) {
+      const auto s = std::to_string(i) + ',';
+      ASSERT_TRUE(writer.write(s));
+      expected += s;
+    }
+    ASSERT_TRUE(writer.sync());
+    EXPECT_EQ(expected, load_file<std::string>(writer.path()));
+
+    ASSERT_TRUE(writer.write(std::string_view{"tail"}));
+    expected += "tail";
+    ASSERT_TRUE(writer.flush());
+    ASSERT_TRUE(writer.sync());
+    EXPECT_EQ(expected, load_file<std::string>(writer.path()));
+  }
+}
+
 TEST(AnonymousFile, basic)
 {
   int fd = -1;
@@ -344,3 +530,319 @@ TEST(copy_all, dir)
   EXPECT_TS_EQ(f2.path(), dstdir / f2.path().filename());
   EXPECT_TS_EQ(f3.path(), dstdir / subdir / f3.path().filename());
 }
+
+TEST(copy_all, file_into_dir)
+{
+  const TempDir dir {"test"};
+  ASSERT_TRUE(create_directory(dir / "dst"));
+  std::ofstream {dir / "src"} << "hello";
+
+  EXPECT_TRUE(copy_all(dir / "src", dir / "dst"));
+  EXPECT_EQ("hello", load_file<std::string>(dir / "dst" / "src"));
+  EXPECT_EQ(last_write_time(dir / "src"), last_write_time(dir / "dst" / "src"));
+}
+
+TEST(copy_tree, attributes)
+{
+  const TempDir srcdir {"test-src"};
+  const TempDir dstdir {"test-dst"};
+  const auto dst = dstdir / "copy";
+
+  const std::vector<uint8_t> big(3 * 1024 * 1024 + 7, 0x5a);
+  ASSERT_TRUE(create_directories(srcdir / "a" / "b"));
+  ASSERT_TRUE(create_directories(srcdir / "c"));
+  std::ofstream {srcdir / "empty"};
+  std::ofstream {srcdir / "a" / "small"} << "hello";
+  std::ofstream {srcdir / "a" / "b" / "big", std::ios::binary}
+    .write(reinterpret_cast<const char *>(big.data()), static_cast<std::streamsize>(big.size()));
+  create_symlink("a/small", srcdir / "link");
+
+  permissions(srcdir / "a" / "small", perms::owner_read | perms::group_read);
+  permissions(srcdir / "c", perms::owner_all | perms::group_read | perms::group_exec);
+  const auto past = last_write_time(srcdir / "a" / "small") - std::chrono::hours {24};
+  last_write_time(srcdir / "a" / "small", past);
+  last_write_time(srcdir / "a" / "b", past);
+
+  copy_progress progress;
+  copy_tree(srcdir, dst, &progress, 4);
+
+  EXPECT_EQ(4, progress.dirs);
+  EXPECT_EQ(3, progress.files);
+  EXPECT_EQ(1, progress.symlinks);
+  EXPECT_EQ(big.size() + 5, progress.bytes);
+  EXPECT_LT(0, progress.throughput());
+
+  EXPECT_EQ(big, load_file(dst / "a" / "b" / "big"));
+  EXPECT_EQ(0, file_size(dst / "empty"));
+  EXPECT_TRUE(is_symlink(dst / "link"));
+  EXPECT_EQ("a/small", read_symlink(dst / "link"));
+  EXPECT_EQ(5, file_size(dst / "link"));
+
+  EXPECT_EQ(perms::owner_read | perms::group_read, status(dst / "a" / "small").permissions());
+  EXPECT_EQ(status(srcdir / "c").permissions(), status(dst / "c").permissions());
+  EXPECT_EQ(past, last_write_time(dst / "a" / "small"));
+  EXPECT_EQ(past, last_write_time(dst / "a" / "b"));
+  EXPECT_EQ(last_write_time(srcdir), last_write_time(dst));
+
+  // no overwrite
+  EXPECT_THROW(copy_tree(srcdir, dst), std::system_error);
+}
+
+TEST(copy_tree, file)
+{
+  const TempDir dir {"test"};
+  std::ofstream {dir / "src"} << "hello";
+  copy_tree(dir / "src", dir / "dst");
+  EXPECT_EQ("hello", load_file<std::string>(dir / "dst"));
+  EXPECT_EQ(last_write_time(dir / "src"), last_write_time(dir / "dst"));
+}
+
+namespace {
+// 1M hole, "head" at 1M, 1M hole, "tail" at 3M and a trailing hole to 4M
+void make_sparse(const path_t &p) {
+  const unique_fd fd {::open(p.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)};
+  ASSERT_EQ(0, ::ftruncate(fd, 4 << 20));
+  ASSERT_EQ(4, ::pwrite(fd, "head", 4, 1 << 20));
+  ASSERT_EQ(4, ::pwrite(fd, "tail", 4, 3 << 20));
+}
+} // namespace
+
+TEST(data_extents, sparse)
+{
+  const TempDir dir {"test"};
+  make_sparse(dir / "sparse");
+
+  const unique_fd fd {::open((dir / "sparse").c_str(), O_RDONLY)};
+  const auto extents = data_extents(fd, 4 << 20);
+  ASSERT_FALSE(extents.empty());
+  EXPECT_LE(extents.size(), 2);
+  size_t ndata = 0;
+  for (const auto &[off, len] : extents) {
+    EXPECT_LE(off + len, 4u << 20);
+    ndata += len;
+  }
+  EXPECT_LT(ndata, 4u << 20);
+  EXPECT_TRUE(std::ranges::any_of(extents,
+        [] (const extent &e) { return e.off <= (1 << 20) && (1 << 20) + 4 <= e.off + e.len; }));
+  EXPECT_TRUE(std::ranges::any_of(extents,
+        [] (const extent &e) { return e.off <= (3 << 20) && (3 << 20) + 4 <= e.off + e.len; }));
+
+  EXPECT_TRUE(data_extents(fd, 0).empty());
+}
+
+TEST(load_file, sparse)
+{
+  const TempDir dir {"test"};
+  make_sparse(dir / "sparse");
+
+  std::string expected(4 << 20, '\0');
+  expected.replace(1 << 20, 4, "head");
+  expected.replace(3 << 20, 4, "tail");
+  EXPECT_EQ(expected, load_file<std::string>(dir / "sparse"));
+}
+
+TEST(copy_tree, sparse)
+{
+  const TempDir dir {"test"};
+  make_sparse(dir / "src");
+  copy_tree(dir / "src", dir / "dst");
+
+  EXPECT_EQ(load_file<std::string>(dir / "src"), load_file<std::string>(dir / "dst"));
+  struct ::stat src, dst;
+  ASSERT_EQ(0, ::stat((dir / "src").c_str(), &src));
+  ASSERT_EQ(0, ::stat((dir / "dst").c_str(), &dst));
+  EXPECT_EQ(src.st_size, dst.st_size);
+  EXPECT_LE(dst.st_blocks, src.st_blocks);
+}
+
+TEST(mapped_file, data_extents)
+{
+  const TempDir dir {"test"};
+  make_sparse(dir / "sparse");
+
+  const mapped_file m {dir / "sparse"};
+  const auto extents = m.data_extents();
+  ASSERT_FALSE(extents.empty());
+  size_t ndata = 0;
+  for (const auto &e : extents) {
+    EXPECT_GE(e.data(), m.span().data());
+    EXPECT_LE(e.data() + e.size(), m.span().data() + m.span().size());
+    ndata += e.size();
+  }
+  EXPECT_LT(ndata, m.span().size());
+  EXPECT_EQ(2, std::ranges::count_if(extents, [] (const auto &e) {
+        const std::string_view s {reinterpret_cast<const char*>(e.data()), e.size()};
+        return s.find("head") != s.npos || s.find("tail") != s.npos;
+      }));
+}
+
+TEST(dir_reader, for_each)
+{
+  const TempDir dir {"test"};
+  ASSERT_TRUE(create_directory(dir / "sub"));
+  std::ofstream {dir / "file"};
+  create_symlink("file", dir / "link");
+
+  const auto fd = ::open(dir.path().c_str(), O_RDONLY | O_DIRECTORY);
+  ASSERT_NE(-1, fd);
+  const unique_fd dirfd {fd};
+
+  dir_reader reader {1024};
+  std::map<std::string, unsigned char> entries;
+  reader.for_each(dirfd, [&] (const std::string_view name, const unsigned char type) {
+      entries.emplace(name, type);
+    });
+  const std::map<std::string, unsigned char> expected {
+    {"sub", DT_DIR}, {"file", DT_REG}, {"link", DT_LNK}};
+  EXPECT_EQ(expected, entries);
+
+  ASSERT_EQ(0, ::lseek(dirfd, 0, SEEK_SET));
+  EXPECT_EQ(3, reader.count(dirfd));
+}
+
+TEST(dir_siz, many)
+{
+  const TempDir dir {"test"};
+  for (int i = 0; i < 1000; ++i) std::ofstream {dir / std::to_string(i)};
+  EXPECT_EQ(1000, dir_siz(dir));
+  EXPECT_THROW(dir_siz(dir / "0"), std::invalid_argument);
+}
+
+TEST(DirectoryIndex, events)
+{
+  const TempDir dir {"test"};
+  std::ofstream {dir / "a"};
+  std::ofstream {dir / "b"};
+
+  std::vector<std::pair<DirectoryIndex::change, std::string>> changes;
+  DirectoryIndex index {dir, [&changes] (const auto c, const std::string_view name) {
+      changes.emplace_back(c, name);
+    }};
+  EXPECT_EQ(2, index.size());
+  EXPECT_THAT(index.names(), ::testing::ElementsAre("a", "b"));
+  EXPECT_EQ(0, index.poll());
+
+  std::ofstream {dir / "c"};
+  remove(dir / "a");
+  rename(dir / "b", dir / "d");
+  ASSERT_TRUE(create_directory(dir / "e"));
+  EXPECT_EQ(5, index.poll(std::chrono::seconds {1}));
+  EXPECT_THAT(index.names(), ::testing::ElementsAre("c", "d", "e"));
+  EXPECT_EQ(dir_siz(dir), index.size());
+
+  using enum DirectoryIndex::change;
+  EXPECT_THAT(changes, ::testing::ElementsAre(
+        std::pair {added, "c"}, std::pair {removed, "a"},
+        std::pair {removed, "b"}, std::pair {added, "d"}, std::pair {added, "e"}));
+  EXPECT_TRUE(index.watching());
+
+  EXPECT_THROW(DirectoryIndex {dir / "c"}, std::system_error);
+}
+
+TEST(DirectoryIndex, gone)
+{
+  const TempDir dir {"test"};
+  const auto sub = dir / "sub";
+  ASSERT_TRUE(create_directory(sub));
+  std::ofstream {sub / "a"};
+
+  DirectoryIndex index {sub};
+  remove_all(sub);
+  EXPECT_EQ(1, index.poll(std::chrono::seconds {1}));
+  EXPECT_TRUE(index.empty());
+  EXPECT_FALSE(index.watching());
+  EXPECT_EQ(0, index.poll(std::chrono::nanoseconds {-1}));
+}
+
+TEST(DirectoryIndex, overflow)
+{
+  const auto limit = std::stoul(load_file<std::string>("/proc/sys/fs/inotify/max_queued_events"));
+  if (limit > 1 << 15) GTEST_SKIP() << "max_queued_events too large: " << limit;
+
+  const TempDir dir {"test"};
+  size_t nadded = 0;
+  DirectoryIndex index {dir, [&nadded] (const auto c, std::string_view) {
+      nadded += c == DirectoryIndex::change::added;
+    }};
+
+  const unique_fd dirfd {::open(dir.path().c_str(), O_RDONLY | O_DIRECTORY)};
+  const auto n = limit + 100;
+  for (size_t i = 0; i < n; ++i)
+    ::close(::openat(dirfd, std::to_string(i).c_str(), O_WRONLY | O_CREAT, 0644));
+
+  EXPECT_EQ(n, index.poll());
+  EXPECT_EQ(n, index.size());
+  EXPECT_EQ(n, nadded);
+}
+
+TEST(walk, tree)
+{
+  const TempDir dir {"test"};
+  std::set<std::string> expected;
+  for (const auto d : {"a", "a/b", "a/b/c", "d", "skip"}) {
+    ASSERT_TRUE(create_directory(dir / d));
+    expected.emplace(d);
+    for (int i = 0; i < 10; ++i) {
+      const auto f = std::string {d} + "/" + std::to_string(i);
+      std::ofstream {dir / f};
+      expected.emplace(f);
+    }
+  }
+
+  std::mutex m;
+  std::set<std::string> visited;
+  walk(dir, [&] (const walk_entry &e) {
+      EXPECT_TRUE(e.name == "skip" || e.name.size() == 1) << e.name;
+      EXPECT_EQ(e.type, std::isdigit(e.name.front()) ? DT_REG : DT_DIR);
+      struct stat st;
+      EXPECT_EQ(0, ::fstatat(e.dirfd, e.name.data(), &st, AT_SYMLINK_NOFOLLOW));
+
+      std::lock_guard lock {m};
+      visited.emplace(e.dir.empty() ? std::string {e.name} : std::string {e.dir} + "/" + std::string {e.name});
+      return e.name != "skip";
+    }, 4);
+  std::erase_if(expected, [] (const auto &p) { return p.starts_with("skip/"); });
+  EXPECT_EQ(expected, visited);
+
+  EXPECT_THROW(walk(dir / "none", [] (const walk_entry &) {}), std::system_error);
+}
+
+TEST(TempFilePool, publish)
+{
+  const TempDir dir {"test"};
+  TempFilePool pool {{.dir = dir.path(), .capacity = 2, .prealloc_siz = 1 << 20}};
+  while (pool.available() < 2) std::this_thread::yield();
+
+  FileWriter<PooledFile> writer {pool};
+  EXPECT_THROW(writer.path(), std::logic_error);
+  ASSERT_TRUE(writer.write(std::string_view {"hello"}));
+
+  struct stat st;
+  ASSERT_EQ(0, ::fstat(writer.fd(), &st));
+  EXPECT_EQ(5, st.st_size);
+  EXPECT_LE(1 << 20, st.st_blocks * 512) << "should be preallocated";
+
+  EXPECT_EQ(0, dir_siz(dir)) << "should be anonymous";
+  writer.file().publish(dir / "published");
+  EXPECT_EQ(dir / "published", writer.path());
+  EXPECT_EQ("hello", load_file<std::string>(dir / "published"));
+
+  // replaces existing one
+  FileWriter<PooledFile> other {pool};
+  ASSERT_TRUE(other.write(std::string_view {"world"}));
+  other.file().publish(dir / "published");
+  EXPECT_EQ("world", load_file<std::string>(dir / "published"));
+  EXPECT_EQ(1, dir_siz(dir));
+}
+
+TEST(TempFilePool, dry)
+{
+  const TempDir dir {"test"};
+  TempFilePool pool {{.dir = dir.path(), .capacity = 1}};
+  std::vector<unique_fd> fds;
+  for (int i = 0; i < 8; ++i) fds.push_back(pool.acquire());
+  for (const auto &fd : fds) EXPECT_TRUE(fd);
+
+  EXPECT_THROW(TempFilePool {{.dir = dir / "none"}}.acquire(), std::system_error);
+  EXPECT_THROW(publish(fds[0], dir / "none" / "file"), std::system_error);
+}
@@ -2,9 +2,12 @@
 #include <gtest/gtest.h>
 #include <array>
 #include <sstream>
+#include <string>
+#include <unistd.h>
 #include <vector>
 
 using gh4ck3r::hexdump;
+using gh4ck3r::hexdump_to;
 
 TEST(hexdump, ptr_len)
 {
@@ -181,3 +184,51 @@ TEST(hexdump, vector16)
 
   EXPECT_EQ(output, hexdump(v));
 }
+
+TEST(hexdump, wide_value)
+{
+  const std::vector<uint16_t> v {0x1234, 0xabcd, 0x41};
+  std::ostringstream oss;
+  oss << static_cast<const void *>(v.data())
+    <<  "  1234 abcd 0041                           ..A\n";
+
+  EXPECT_EQ(oss.str(), hexdump(v));
+}
+
+TEST(hexdump_to, ostream)
+{
+  std::vector<uint8_t> buf(100 * 0x10 + 3);
+  for (size_t i = 0; i < buf.size(); ++i) buf[i] = static_cast<uint8_t>(i * 7);
+
+  std::ostringstream oss;
+  hexdump_to(oss, buf);
+  EXPECT_EQ(hexdump(buf), oss.str());
+}
+
+TEST(hexdump_to, callback)
+{
+  const std::vector<uint32_t> v(1000, 0xdeadbeef);
+
+  std::string out;
+  size_t ncall = 0;
+  hexdump_to([&] (std::string_view rows) { out += rows; ++ncall; }, v);
+  EXPECT_EQ(hexdump(v), out);
+  EXPECT_GT(ncall, 1u);
+}
+
+TEST(hexdump_to, fd)
+{
+  constexpr char buf[] {"hello world"};
+
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  hexdump_to(fds[1], buf, sizeof(buf));
+  close(fds[1]);
+
+  std::string out(256, '\0');
+  out.resize(static_cast<size_t>(read(fds[0], out.data(), out.size())));
+  close(fds[0]);
+
+  EXPECT_EQ(hexdump(buf, sizeof(buf)), out);
+  EXPECT_THROW(hexdump_to(-1, buf, sizeof(buf)), std::system_error);
+}
@@ -1,7 +1,14 @@
 #include "gh4ck3r/lazygetter.hh"
 #include <gtest/gtest.h>
+#include <atomic>
+#include <latch>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
 using gh4ck3r::LazyGetter;
+using gh4ck3r::UnsyncLazyGetter;
 
 TEST(LazyGetter, primitive)
 {
@@ -55,3 +62,97 @@ TEST(LazyGetter, string_view)
   EXPECT_EQ(val, getter);
   EXPECT_EQ(1, cnt);
 }
+
+TEST(LazyGetter, concurrent)
+{
+  std::atomic<size_t> cnt {};
+  const std::string val {"hello world"};
+  LazyGetter getter {[&] { cnt++; return val; }};
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.emplace_back([&] {
+        for (int j = 0; j < 1000; ++j) EXPECT_EQ(val, getter);
+      });
+  }
+  for (auto &t : threads) t.join();
+  EXPECT_EQ(1, cnt);
+}
+
+TEST(LazyGetter, retry_after_throw)
+{
+  size_t cnt {};
+  LazyGetter getter {[&cnt] {
+      if (!cnt++) throw std::runtime_error {"first"};
+      return 10;
+    }};
+  EXPECT_THROW(getter.get(), std::runtime_error);
+  EXPECT_EQ(10, getter);
+  EXPECT_EQ(2, cnt);
+}
+
+TEST(LazyGetter, assign_throw)
+{
+  struct bad {
+    operator std::string() const { throw std::runtime_error {"bad"}; }
+  };
+  LazyGetter getter {[s = std::string(100, 'x')] { return s; }};
+  EXPECT_THROW(getter = bad {}, std::runtime_error);
+  EXPECT_EQ(std::string(100, 'x'), getter);
+}
+
+TEST(LazyGetter, assign_while_fetching)
+{
+  std::latch fetching {1};
+  LazyGetter getter {[&fetching, s = std::string(100, 'x')] {
+      fetching.count_down();
+      std::this_thread::sleep_for(std::chrono::milliseconds {10});
+      return s;
+    }};
+
+  std::thread t {[&] { static_cast<void>(getter.get()); }};
+  fetching.wait();
+  getter = "assigned";
+  t.join();
+  EXPECT_EQ("assigned", getter);
+}
+
+TEST(UnsyncLazyGetter, primitive)
+{
+  size_t cnt {};
+  constexpr int val = 10;
+  UnsyncLazyGetter getter {[&cnt] { cnt++; return val; }};
+  EXPECT_EQ(0, cnt);
+  EXPECT_EQ(val, getter);
+  EXPECT_EQ(1, cnt);
+  EXPECT_EQ(val + 1, ++getter);
+  EXPECT_EQ(1, cnt);
+  getter = val / 2;
+  EXPECT_EQ(5, getter);
+  EXPECT_EQ(1, cnt);
+}
+
+TEST(LazyGetter, prefetch)
+{
+  // Each getter waits for the others, which passes only if they run at once.
+  std::latch all {3};
+  const auto fetch = [&all] (auto v) {
+    return [&all, v] { all.arrive_and_wait(); return v; };
+  };
+  LazyGetter a {fetch(1)};
+  LazyGetter b {fetch(std::string {"two"})};
+  UnsyncLazyGetter c {fetch(3.0)};
+
+  gh4ck3r::prefetch(a, b, c);
+  EXPECT_EQ(1, a);
+  EXPECT_EQ("two", b);
+  EXPECT_EQ(3.0, c);
+}
+
+TEST(LazyGetter, prefetch_throw)
+{
+  LazyGetter a {[] { return 1; }};
+  LazyGetter b {[]() -> int { throw std::runtime_error {"b"}; }};
+  EXPECT_THROW(gh4ck3r::prefetch(a, b), std::runtime_error);
+  EXPECT_EQ(1, a);
+}
@@ -1,6 +1,10 @@
 #include "gh4ck3r/logger.hh"
 #include <gtest/gtest.h>
+#include <atomic>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 using gh4ck3r::Logger;
 using gh4ck3r::indent;
@@ -80,3 +84,210 @@ TEST(logger, indent_multi)
   end)"};
   EXPECT_EQ(expected, oss.str());
 }
+
+using gh4ck3r::AsyncLogger;
+
+namespace {
+
+// Sink holding up the background thread until opened.
+class gated_buf : public std::stringbuf {
+ public:
+  std::atomic<bool> entered {false};
+  std::atomic<bool> open {false};
+
+ private:
+  std::streamsize xsputn(const char* s, std::streamsize n) override {
+    entered = true;
+    entered.notify_all();
+    open.wait(false);
+    return std::stringbuf::xsputn(s, n);
+  }
+};
+
+} // namespace
+
+TEST(async_logger, basic)
+{
+  std::ostringstream oss;
+  AsyncLogger logger{oss};
+
+  logger << "begin" << '\n';
+  logger << indent() << "hello\n" << unindent();
+  logger << "end";
+  logger.flush();
+
+  EXPECT_EQ("begin\n  hello\nend", oss.str());
+}
+
+TEST(async_logger, indent_across_records)
+{
+  std::ostringstream oss;
+  AsyncLogger logger{oss};
+
+  logger << indent();
+  logger << "first ";
+  logger << "line\n" << indent();
+  logger << "second\n";
+  logger << unindent(2) << "third";
+  logger.flush();
+
+  EXPECT_EQ("  first line\n    second\nthird", oss.str());
+}
+
+TEST(async_logger, threads)
+{
+  constexpr int nthread = 4, nline = 1000;
+  std::ostringstream oss;
+  {
+    AsyncLogger logger{oss, {.ring_siz = 1024}};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nthread; ++t) {
+      threads.emplace_back([&logger, t] {
+          for (int i = 0; i < nline; ++i) logger << t << ' ' << i << '\n';
+        });
+    }
+    for (auto& t : threads) t.join();
+  }
+
+  std::istringstream iss {oss.str()};
+  std::vector<int> next(nthread, 0);
+  for (int t, i; iss >> t >> i;) {
+    ASSERT_LT(t, nthread);
+    EXPECT_EQ(next[t]++, i);
+  }
+  EXPECT_EQ(std::vector<int>(nthread, nline), next);
+}
+
+TEST(async_logger, drop)
+{
+  gated_buf sink;
+  std::ostream os {&sink};
+  {
+    AsyncLogger logger{os, {.ring_siz = 64, .policy = AsyncLogger::overflow_policy::drop}};
+    logger << "first\n";
+    sink.entered.wait(false);
+
+    for (int i = 0; i < 100; ++i) logger << "record " << i << '\n';
+    EXPECT_GT(logger.dropped(), 0u);
+
+    sink.open = true;
+    sink.open.notify_all();
+  }
+  EXPECT_TRUE(sink.str().starts_with("first\nrecord 0\n"));
+  EXPECT_EQ(std::string::npos, sink.str().find("record 99\n"));
+}
+
+TEST(async_logger, overwrite)
+{
+  gated_buf sink;
+  std::ostream os {&sink};
+  {
+    AsyncLogger logger{os, {.ring_siz = 64, .policy = AsyncLogger::overflow_policy::overwrite}};
+    logger << "first\n";
+    sink.entered.wait(false);
+
+    for (int i = 0; i < 100; ++i) logger << "record " << i << '\n';
+    EXPECT_GT(logger.dropped(), 0u);
+
+    sink.open = true;
+    sink.open.notify_all();
+  }
+  EXPECT_TRUE(sink.str().starts_with("first\n"));
+  EXPECT_EQ(std::string::npos, sink.str().find("record 0\n"));
+  EXPECT_TRUE(sink.str().ends_with("record 99\n"));
+}
+
+TEST(record_ring, overwrite_while_draining)
+{
+  gh4ck3r::detail::logger::record_ring ring {256};
+  std::atomic<bool> done {false};
+
+  // records of `i % 26` letters of `'a' + i % 26`
+  std::thread producer {[&] {
+    for (size_t i = 0; i < 100000; ++i)
+      ring.push_overwrite(std::string(i % 26, static_cast<char>('a' + i % 26)));
+    done = true;
+  }};
+
+  std::string out;
+  for (bool last = false; !last;) {
+    last = done;
+    out.clear();
+    ring.drain(out);
+    for (size_t i = 0; i < out.size();) {
+      const auto c = out[i];
+      const auto len = static_cast<size_t>(c - 'a');
+      ASSERT_LE(i + len, out.size());
+      ASSERT_EQ(std::string(len, c), out.substr(i, len));
+      i += len;
+    }
+  }
+  producer.join();
+}
+
+TEST(async_logger, oversized)
+{
+  std::ostringstream oss;
+  AsyncLogger logger{oss, {.ring_siz = 64}};
+
+  logger << std::string(100, 'x');
+  logger << "fits";
+  logger.flush();
+
+  EXPECT_EQ(1u, logger.dropped());
+  EXPECT_EQ("fits", oss.str());
+}
+
+TEST(logger, long_lines)
+{
+  std::ostringstream oss;
+  Logger logger{oss};
+
+  std::string text, expected;
+  for (int i = 0; i < 100; ++i) {
+    const auto line = std::string(static_cast<size_t>(i), 'a' + i % 26) + '\n';
+    text += line;
+    expected += "    " + line;
+  }
+  logger << indent(2) << text << "\n" << "tail";
+  expected += "    \n    tail";
+
+  EXPECT_EQ(expected, oss.str());
+}
+
+TEST(logger, empty)
+{
+  std::ostringstream oss;
+  Logger logger{oss};
+
+  logger << indent() << "" << std::string {} << "x";
+  EXPECT_EQ("  x", oss.str());
+}
+
+TEST(logger, buffered)
+{
+  std::ostringstream oss;
+  Logger logger{oss, 64};
+
+  logger << "begin\n" << indent() << "hello";
+  // indentation flushes what was written before it
+  EXPECT_EQ("begin\n", oss.str());
+
+  logger << ", world\n" << 'x';
+  EXPECT_EQ("begin\n", oss.str());
+
+  logger << unindent() << '\n' << std::string(100, 'y') << '\n';
+  logger << "end" << std::flush;
+  EXPECT_EQ("begin\n  hello, world\n  x\n" + std::string(100, 'y') + "\nend", oss.str());
+}
+
+TEST(logger, buffered_destruct)
+{
+  std::ostringstream oss;
+  {
+    Logger logger{oss, 64};
+    logger << indent() << "pending";
+    EXPECT_TRUE(oss.str().empty());
+  }
+  EXPECT_EQ("  pending", oss.str());
+}
@@ -2,6 +2,7 @@
 #include <gtest/gtest.h>
 
 #include <chrono>
+#include <map>
 #include <cstdlib>
 #include <fcntl.h>
 #include <unistd.h>
@@ -85,6 +86,185 @@ TEST(process_exec, wait_timeout)
   EXPECT_EQ(wait(pid), static_cast<int>(exit_code::signaled) + SIGKILL ) << "should be killed by SIGKILL";
 }
 
+TEST(process_spawn, simple)
+{
+  const auto child = spawn("/bin/true");
+  ASSERT_GT(child.pid, 0);
+  EXPECT_TRUE(child.pidfd);
+  EXPECT_EQ(ppidof(child.pid), getpid());
+
+  EXPECT_EQ(wait(child), 0);
+}
+
+TEST(process_spawn, exit_code)
+{
+  const auto child = spawn("/bin/sh", "-c", "exit 3");
+  EXPECT_EQ(wait(child), 3);
+}
+
+TEST(process_spawn, redirect_stdout)
+{
+  int pipefd[2];
+  ASSERT_NE(pipe2(pipefd, O_CLOEXEC), -1);
+
+  const auto child = spawn(STDIN_FILENO, pipefd[1], STDERR_FILENO,
+                           "/bin/echo", "hello", "world");
+  EXPECT_EQ(wait(child), 0);
+  EXPECT_EQ(::close(pipefd[1]), 0);
+
+  std::string buf {"hello, world"};
+  buf.erase(read(pipefd[0], buf.data(), buf.size()));
+  EXPECT_EQ(buf, "hello world\n");
+
+  EXPECT_EQ(::close(pipefd[0]), 0);
+}
+
+TEST(process_spawn, close_stdout)
+{
+  const auto child = spawn(STDIN_FILENO, -1, -1,
+                           "/bin/sh", "-c", "echo hello >&1");
+  EXPECT_NE(wait(child), 0) << "stdout should be closed";
+}
+
+TEST(process_spawn, close_after_dup)
+{
+  if (!gh4ck3r::filesystem::is_valid(STDIN_FILENO)) GTEST_SKIP() << "no stdin";
+
+  // stdin is closed only after it's duplicated to stdout
+  const auto child = spawn(-1, STDIN_FILENO, STDERR_FILENO, "/bin/true");
+  EXPECT_EQ(wait(child), 0);
+}
+
+TEST(process_spawn, wait_timeout)
+{
+  const auto child = spawn("/bin/sleep", 2);
+
+  using namespace std::chrono_literals;
+  EXPECT_THROW(wait_for(child, 100ms), timeout_error);
+
+  ::kill(child.pid, SIGKILL);
+  EXPECT_EQ(wait_for(child, 1s), static_cast<int>(exit_code::signaled) + SIGKILL);
+}
+
+TEST(process_spawn, not_executable)
+{
+  EXPECT_THROW((void)spawn("/etc/passwd"), std::invalid_argument);
+}
+
+TEST(timer_wheel, expire)
+{
+  using namespace std::chrono_literals;
+  using clock = std::chrono::steady_clock;
+  const auto start = clock::now();
+  detail::timer_wheel<int> wheel {10ms, 8, start};
+
+  wheel.schedule(start + 15ms, 1);
+  wheel.schedule(start + 200ms, 2);  // several revolutions ahead
+  wheel.schedule(start + 20ms, 3);
+  EXPECT_EQ(wheel.size(), 3);
+  EXPECT_EQ(start + 20ms, wheel.next_deadline());
+
+  std::vector<int> fired;
+  const auto collect = [&] (int v) { fired.push_back(v); };
+  wheel.advance(start + 14ms, collect);
+  EXPECT_TRUE(fired.empty());
+
+  wheel.advance(start + 20ms, collect);
+  EXPECT_EQ(fired, (std::vector {1, 3}));
+  // no wakeups on the empty ticks in between
+  EXPECT_EQ(start + 200ms, wheel.next_deadline());
+
+  wheel.advance(start + 199ms, collect);
+  EXPECT_EQ(fired.size(), 2);
+  EXPECT_EQ(start + 200ms, wheel.next_deadline());
+
+  wheel.advance(start + 1s, collect);
+  EXPECT_EQ(fired, (std::vector {1, 3, 2}));
+  EXPECT_TRUE(wheel.empty());
+  EXPECT_FALSE(wheel.next_deadline());
+}
+
+TEST(timer_wheel, past_deadline)
+{
+  using namespace std::chrono_literals;
+  using clock = std::chrono::steady_clock;
+  const auto start = clock::now();
+  detail::timer_wheel<int> wheel {10ms, 8, start};
+
+  wheel.schedule(start - 1s, 1);  // e.g. a negative timeout
+  wheel.schedule(start, 2);
+
+  std::vector<int> fired;
+  wheel.advance(start + 10ms, [&] (int v) { fired.push_back(v); });
+  std::ranges::sort(fired);
+  EXPECT_EQ(fired, (std::vector {1, 2}));
+  EXPECT_TRUE(wheel.empty());
+}
+
+TEST(ChildSet, reap)
+{
+  ChildSet children;
+  std::map<pid_t, int> expected;
+  for (int i = 0; i < 16; ++i) {
+    auto child = spawn("/bin/sh", "-c", "exit " + std::to_string(i));
+    expected[child.pid] = i;
+    children.add(std::move(child));
+  }
+  EXPECT_EQ(children.size(), expected.size());
+
+  std::vector<Completion> done;
+  while (!children.empty()) children.reap(done);
+
+  ASSERT_EQ(done.size(), expected.size());
+  for (const auto &c : done) {
+    EXPECT_EQ(c.status, expected.at(c.pid));
+    EXPECT_FALSE(c.timed_out);
+  }
+}
+
+TEST(ChildSet, deadline)
+{
+  using namespace std::chrono_literals;
+
+  ChildSet children;
+  auto slow = spawn("/bin/sleep", 5);
+  const auto slow_pid = slow.pid;
+  children.add(std::move(slow), 50ms);
+  children.add(execute("/bin/true"));
+
+  std::vector<Completion> done;
+  const auto start = std::chrono::steady_clock::now();
+  while (!children.empty()) children.reap(done, 1s);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, 2s);
+
+  ASSERT_EQ(done.size(), 2);
+  for (const auto &c : done) {
+    if (c.pid == slow_pid) {
+      EXPECT_TRUE(c.timed_out);
+      EXPECT_EQ(c.status, static_cast<int>(exit_code::signaled) + SIGKILL);
+    } else {
+      EXPECT_FALSE(c.timed_out);
+      EXPECT_EQ(c.status, 0);
+    }
+  }
+}
+
+TEST(ChildSet, reap_timeout)
+{
+  using namespace std::chrono_literals;
+
+  ChildSet children;
+  auto child = spawn("/bin/sleep", 5);
+  const auto pid = child.pid;
+  children.add(std::move(child));
+
+  EXPECT_EQ(children.reap(10ms).size(), 0);
+  ::kill(pid, SIGTERM);
+  const auto done = children.reap();
+  ASSERT_EQ(done.size(), 1);
+  EXPECT_EQ(done.front().status, static_cast<int>(exit_code::signaled) + SIGTERM);
+}
+
 struct EnvTest : ::testing::Test {
  protected:
   static size_t count_env_var() {
@@ -115,6 +295,95 @@ TEST_F(EnvTest, iterate)
   EXPECT_EQ(cnt, 0);
 }
 
+TEST_F(EnvTest, get_set_erase)
+{
+  Env env {};
+  ASSERT_TRUE(env.get("PATH"));
+  EXPECT_EQ(*env.get("PATH"), std::getenv("PATH"));
+  EXPECT_FALSE(env.get("GH4CK3R_UNSET"));
+
+  env.set("GH4CK3R_FOO", "a=b");
+  env["GH4CK3R_BAR"] = "bar";
+  env.erase("PATH");
+  EXPECT_EQ(*env.get("GH4CK3R_FOO"), "a=b");
+  EXPECT_EQ(std::string_view {env["GH4CK3R_BAR"]}, "bar");
+  EXPECT_FALSE(env.get("PATH"));
+  EXPECT_EQ(env.size(), count_env_var() + 1);
+  EXPECT_THROW(env.set("A=B", "c"), std::invalid_argument);
+}
+
+TEST_F(EnvTest, envp)
+{
+  const char *init[] {"B=2", "A=1", "B=3", "C=", nullptr};
+  Env env {const_cast<char *const *>(init)};
+  ASSERT_EQ(env.size(), 3);
+
+  const char * const *envp = env;
+  EXPECT_STREQ(envp[0], "A=1");
+  EXPECT_STREQ(envp[1], "B=3");
+  EXPECT_STREQ(envp[2], "C=");
+  EXPECT_EQ(envp[3], nullptr);
+  EXPECT_EQ(envp, static_cast<char *const *>(env)) << "should be cached";
+
+  env.set("AB", "x");
+  env.erase("C");
+  envp = env;
+  EXPECT_STREQ(envp[0], "A=1");
+  EXPECT_STREQ(envp[1], "AB=x");
+  EXPECT_STREQ(envp[2], "B=3");
+  EXPECT_EQ(envp[3], nullptr);
+
+  const char *malformed[] {"A", nullptr};
+  EXPECT_THROW(Env {const_cast<char *const *>(malformed)}, std::invalid_argument);
+}
+
+TEST_F(EnvTest, derive)
+{
+  const Env base {};
+  const char * const *base_envp = base;
+
+  Env derived {base, {{"GH4CK3R_FOO", "foo"}}};
+  EXPECT_EQ(base.size() + 1, derived.size());
+  EXPECT_FALSE(base.get("GH4CK3R_FOO"));
+  EXPECT_EQ(base_envp, static_cast<char *const *>(base));
+
+  const Env copy {base};
+  EXPECT_EQ(base_envp, static_cast<char *const *>(copy)) << "should share the base";
+
+  int pipefd[2];
+  ASSERT_EQ(pipe(pipefd), 0);
+  const auto child = spawn(STDIN_FILENO, pipefd[1], STDERR_FILENO,
+      "/bin/sh", Argv {"sh", "-c", "printf %s \"$GH4CK3R_FOO\""}, derived);
+  close(pipefd[1]);
+  char buf[8] {};
+  EXPECT_EQ(read(pipefd[0], buf, sizeof(buf)), 3);
+  close(pipefd[0]);
+  EXPECT_STREQ(buf, "foo");
+  EXPECT_EQ(wait(child), 0);
+}
+
+TEST(Argv, cached)
+{
+  Argv argv {"a", "bc"};
+  const char * const *p = argv;
+  EXPECT_STREQ(p[0], "a");
+  EXPECT_STREQ(p[1], "bc");
+  EXPECT_EQ(p[2], nullptr);
+  EXPECT_EQ(p, static_cast<char *const *>(argv));
+
+  const Argv copy {argv};
+  argv.emplace_back(std::string(100, 'd'));
+  p = argv;
+  ASSERT_EQ(argv.size(), 3);
+  EXPECT_EQ(argv[2], std::string(100, 'd'));
+  EXPECT_EQ(p[3], nullptr);
+
+  const char * const *q = copy;
+  EXPECT_NE(p[0], q[0]);
+  EXPECT_STREQ(q[1], "bc");
+  EXPECT_EQ(q[2], nullptr);
+}
+
 TEST(ppidof, malformed_name)
 {
   constexpr std::string_view malformed_name {" ) "};
@@ -130,3 +399,70 @@ TEST(ppidof, malformed_name)
   EXPECT_EQ(getpid(), ppidof(pid));
   EXPECT_EQ(wait(pid), 0);
 }
+
+TEST(ProcSnapshot, parse_stat)
+{
+  const auto st = gh4ck3r::process::detail::parse_stat(
+      "42 (a) (b) c) S 1 42 42 0 -1 4194560 100 0 0 0 7 3 0 0 20 0 1 0 123 4096 5 18446744073709551615");
+  EXPECT_EQ(st.comm, "a) (b) c");
+  EXPECT_EQ(st.state, 'S');
+  EXPECT_EQ(st.ppid, 1);
+  EXPECT_EQ(st.utime, 7);
+  EXPECT_EQ(st.starttime, 123);
+  EXPECT_EQ(st.rss, 5);
+
+  EXPECT_THROW(gh4ck3r::process::detail::parse_stat("42 a S 1"), std::runtime_error);
+}
+
+TEST(ProcSnapshot, self)
+{
+  const ProcSnapshot snapshot;
+  ASSERT_FALSE(snapshot.empty());
+  EXPECT_TRUE(std::is_sorted(snapshot.pids().begin(), snapshot.pids().end()));
+
+  const auto i = snapshot.find(getpid());
+  ASSERT_TRUE(i);
+  EXPECT_EQ(snapshot.ppids()[*i], getppid());
+  EXPECT_EQ(snapshot.states()[*i], 'R');
+  EXPECT_LT(0, snapshot.rss()[*i]);
+  EXPECT_EQ(snapshot.comm(*i), nameof(getpid()));
+
+  const auto cmd = cmdof(getpid());
+  const auto cmdline = snapshot.cmdline(*i);
+  EXPECT_EQ(cmdline.substr(0, cmdline.find('\0')), cmd.front());
+
+  EXPECT_FALSE(snapshot.find(0));
+}
+
+TEST(ProcSnapshot, long_comm)
+{
+  // kernel worker names aren't bound to TASK_COMM_LEN
+  const ProcSnapshot snapshot;
+  for (size_t i = 0; i < snapshot.size(); ++i) {
+    std::string stat;
+    std::getline(std::ifstream {"/proc/" + std::to_string(snapshot.pids()[i]) + "/stat"}, stat);
+    if (stat.empty()) continue;   // gone meanwhile
+    EXPECT_EQ(snapshot.comm(i), gh4ck3r::process::detail::parse_stat(stat).comm);
+  }
+}
+
+TEST(ProcSnapshot, refresh)
+{
+  ProcSnapshot snapshot;
+
+  const auto child = spawn("/bin/sleep", 5);
+  EXPECT_FALSE(snapshot.find(child.pid));
+
+  snapshot.refresh();
+  const auto i = snapshot.find(child.pid);
+  ASSERT_TRUE(i);
+  EXPECT_EQ(snapshot.ppids()[*i], getpid());
+  EXPECT_EQ(snapshot.cmdline(*i), std::string_view("/bin/sleep\0" "5", 13));
+  ASSERT_TRUE(snapshot.find(getpid()));
+  EXPECT_EQ(snapshot.comm(*snapshot.find(getpid())), nameof(getpid()));
+
+  ::kill(child.pid, SIGKILL);
+  EXPECT_NE(wait(child), 0);
+  snapshot.refresh();
+  EXPECT_FALSE(snapshot.find(child.pid));
+}
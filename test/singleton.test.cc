@@ -1,16 +1,22 @@
 #include <gh4ck3r/singleton.hh>
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include <dlfcn.h>
 #include <gnu/lib-names.h>
 
 using namespace gh4ck3r::singleton;
 
+namespace {
+void *dlopen() { return ::dlopen(LIBM_SO, RTLD_LAZY); }
+void dlclose(void *p) { if (::dlclose(p)) FAIL(); }
+} // namespace
+
 TEST(SharedSingleton, dl)
 {
-  constexpr auto dlopen = [] { return ::dlopen(LIBM_SO, RTLD_LAZY); };
-  constexpr auto dlclose = [] (auto *p) { if (::dlclose(p)) FAIL(); };
-
   using libm = SharedSingleton<void, dlopen, dlclose>;
 
   EXPECT_EQ(0, libm::use_count());
@@ -33,6 +39,45 @@ TEST(SharedSingleton, dl)
   EXPECT_EQ(0, libm::use_count());
 }
 
+TEST(SharedSingleton, concurrent)
+{
+  static std::atomic<int> ncreated, ndestroyed;
+  struct Counted {
+    Counted() { ++ncreated; }
+    ~Counted() { ++ndestroyed; }
+  };
+  using S = SharedSingleton<Counted>;
+
+  {
+    const S keep;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i) {
+      threads.emplace_back([&keep] {
+          for (int j = 0; j < 10000; ++j) EXPECT_EQ(keep.get(), S {}.get());
+        });
+    }
+    for (auto &t : threads) t.join();
+    EXPECT_EQ(1, ncreated);
+    EXPECT_EQ(1, S::use_count());
+  }
+  EXPECT_EQ(1, ndestroyed);
+  EXPECT_EQ(0, S::use_count());
+
+  // instances come and go without one kept alive
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.emplace_back([] {
+        for (int j = 0; j < 1000; ++j) {
+          const S s;
+          EXPECT_EQ(s.get(), S {}.get());
+        }
+      });
+  }
+  for (auto &t : threads) t.join();
+  EXPECT_EQ(ncreated, ndestroyed);
+  EXPECT_EQ(0, S::use_count());
+}
+
 class SingletonTraitsTest: public ::testing::Test {
  protected:
   class Descendant : SingletonTraits {};
@@ -125,3 +125,61 @@ TEST(split, escape_sep3)
 }
 
 } //  namespace gh4ck3r
+
+namespace gh4ck3r {
+
+TEST(split_view, lazy)
+{
+  static_assert(std::ranges::forward_range<split_view<','>>);
+  static_assert(std::ranges::view<split_view<','>>);
+
+  std::vector<std::string_view> values;
+  for (const auto v : split_view<','> {"1,2,,3,"}) values.push_back(v);
+  ASSERT_EQ(values.size(), 5);
+  EXPECT_EQ(values[0], "1");
+  EXPECT_EQ(values[1], "2");
+  EXPECT_TRUE(values[2].empty());
+  EXPECT_EQ(values[3], "3");
+  EXPECT_TRUE(values[4].empty());
+}
+
+TEST(split_view, any_of)
+{
+  std::vector<std::string_view> values;
+  for (const auto v : split_view<any_of<',', '|', '/'>> {"1,2|3/4"})
+    values.push_back(v);
+  ASSERT_EQ(values.size(), 4);
+  EXPECT_EQ(values[0], "1");
+  EXPECT_EQ(values[1], "2");
+  EXPECT_EQ(values[2], "3");
+  EXPECT_EQ(values[3], "4");
+}
+
+TEST(split_view, escape_long)
+{
+  // separators and escapes spread over several SIMD blocks
+  std::string str;
+  std::vector<std::string> expected;
+  for (int i = 0; i < 50; ++i) {
+    std::string token(static_cast<size_t>(i), 'a' + static_cast<char>(i % 26));
+    if (i % 3 == 0) token += R"(\,)";
+    if (i % 5 == 0) token += R"(\\)";
+    expected.push_back(token);
+    str += token + (i % 2 ? "," : ";");
+  }
+  expected.emplace_back();
+
+  const split_view<any_of<',', ';'>, '\\'> view {str};
+  EXPECT_EQ(std::ranges::distance(view), expected.size());
+  EXPECT_TRUE(std::ranges::equal(view, expected));
+}
+
+TEST(split, escape_consecutive)
+{
+  const auto values = split<',', '\\'>(R"(1\,2\,3,4)");
+  ASSERT_EQ(values.size(), 2);
+  EXPECT_EQ(values[0], R"(1\,2\,3)");
+  EXPECT_EQ(values[1], "4");
+}
+
+} //  namespace gh4ck3r